@@ -0,0 +1,179 @@
+/*
+ * Counts the heap allocations of listing courses, assessments and problems
+ * the way show_courses, show_assessments and show_problems do, with the plain
+ * structs of autolab.h and with the views of views.h. The lists are served
+ * from the response cache, so both read and parse the same cached body; the
+ * difference is the strings copied out of the parsed response.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "autolab/autolab.h"
+#include "autolab/client.h"
+#include "autolab/views.h"
+
+#include "scratch_dir.h"
+#include "stand_in_server.h"
+
+/* allocation counting */
+
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> allocated_bytes(0);
+
+void *operator new(std::size_t size) {
+  allocations++;
+  allocated_bytes += size;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+const int num_elements = 1000;
+
+static std::string make_list(const std::function<std::string(const std::string &)> &element) {
+  std::string json("[");
+  for (int i = 0; i < num_elements; i++) {
+    if (i > 0) json.append(",");
+    json.append(element(std::to_string(i)));
+  }
+  json.append("]");
+  return json;
+}
+
+// names are long enough not to fit in the small string buffer
+static std::string course_json(const std::string &id) {
+  return "{\"name\":\"15213-f20-course" + id + "\","
+    "\"display_name\":\"Introduction to Computer Systems " + id + "\","
+    "\"semester\":\"f20\",\"late_slack\":0,\"grace_days\":5,\"auth_level\":\"student\"}";
+}
+
+static std::string assessment_json(const std::string &id) {
+  return "{\"name\":\"assessment" + id + "\",\"display_name\":\"Assessment number " + id + "\","
+    "\"category_name\":\"Labs\",\"start_at\":\"2020-01-01T00:00:00.000-05:00\","
+    "\"due_at\":\"2020-02-01T00:00:00.000-05:00\","
+    "\"end_at\":\"2020-02-02T00:00:00.000-05:00\","
+    "\"grading_deadline\":\"2020-02-03T00:00:00.000-05:00\"}";
+}
+
+static std::string problem_json(const std::string &id) {
+  return "{\"name\":\"problem" + id + "\",\"description\":\"Description of problem " + id + "\","
+    "\"max_score\":10.0,\"optional\":false}";
+}
+
+/* the listings, reading the fields the show_* commands print */
+
+static size_t list_courses(Autolab::Client &client) {
+  std::vector<Autolab::Course> courses;
+  client.get_courses(courses);
+  size_t chars = 0;
+  for (auto &c : courses) chars += c.name.length() + c.display_name.length();
+  return chars;
+}
+
+static size_t list_course_views(Autolab::Client &client) {
+  Autolab::ViewList<Autolab::CourseView> courses;
+  client.get_courses(courses);
+  size_t chars = 0;
+  for (auto &c : courses) chars += c.name().length() + c.display_name().length();
+  return chars;
+}
+
+static size_t list_assessments(Autolab::Client &client) {
+  std::vector<Autolab::Assessment> asmts;
+  client.get_assessments(asmts, "course");
+  size_t chars = 0;
+  for (auto &a : asmts) chars += a.name.length() + a.category_name.length();
+  return chars;
+}
+
+static size_t list_assessment_views(Autolab::Client &client) {
+  Autolab::ViewList<Autolab::AssessmentView> asmts;
+  client.get_assessments(asmts, "course");
+  size_t chars = 0;
+  for (auto &a : asmts) chars += a.name().length() + a.category_name().length();
+  return chars;
+}
+
+static size_t list_problems(Autolab::Client &client) {
+  std::vector<Autolab::Problem> probs;
+  client.get_problems(probs, "course", "asmt");
+  size_t chars = 0;
+  for (auto &p : probs) chars += p.name.length() + (p.max_score > 0);
+  return chars;
+}
+
+static size_t list_problem_views(Autolab::Client &client) {
+  Autolab::ViewList<Autolab::ProblemView> probs;
+  client.get_problems(probs, "course", "asmt");
+  size_t chars = 0;
+  for (auto &p : probs) chars += p.name().length() + (p.max_score() > 0);
+  return chars;
+}
+
+struct counts {
+  size_t allocations;
+  size_t bytes;
+};
+
+static counts count_allocations(Autolab::Client &client,
+  size_t (*list)(Autolab::Client &))
+{
+  size_t start_allocations = allocations;
+  size_t start_bytes = allocated_bytes;
+  list(client);
+  return {allocations - start_allocations, allocated_bytes - start_bytes};
+}
+
+static bool report(const char *name, Autolab::Client &client,
+  size_t (*list_structs)(Autolab::Client &), size_t (*list_views)(Autolab::Client &))
+{
+  // the first listing fetches the list from the server into the cache
+  if (list_structs(client) != list_views(client)) {
+    std::fprintf(stderr, "%s: views and structs differ\n", name);
+    return false;
+  }
+  counts structs = count_allocations(client, list_structs);
+  counts views = count_allocations(client, list_views);
+  std::printf("%-12s %-8s %12zu %12.1f %12zu\n", name, "structs", structs.allocations,
+    (double)structs.allocations / num_elements, structs.bytes);
+  std::printf("%-12s %-8s %12zu %12.1f %12zu\n", name, "views", views.allocations,
+    (double)views.allocations / num_elements, views.bytes);
+  return views.allocations < structs.allocations;
+}
+
+int main() {
+  stand_in_server server;
+  scratch_dir cache_dir("alloc-bench");
+  server.set_resource("/courses", make_list(course_json));
+  server.set_resource("/assessments", make_list(assessment_json));
+  server.set_resource("/problems", make_list(problem_json));
+
+  Autolab::Client client(server.base_uri(), "id", "secret", "uri",
+    (void (*)(std::string, std::string))nullptr);
+  client.set_tokens("access", "refresh");
+  client.set_ca_file(server.ca_file());
+  client.enable_response_cache(cache_dir.path());
+
+  std::printf("%d elements per list, read from the response cache\n", num_elements);
+  std::printf("%-12s %-8s %12s %12s %12s\n", "list", "type", "allocations",
+    "per element", "bytes");
+  bool ok = report("courses", client, list_courses, list_course_views);
+  ok = report("assessments", client, list_assessments, list_assessment_views) && ok;
+  ok = report("problems", client, list_problems, list_problem_views) && ok;
+
+  if (!ok) {
+    std::fprintf(stderr, "views did not save allocations\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Decodes 10k-element lists of courses, assessments and problems through the
+ * field tables of client.cpp, and compares them with the get_*_force helper
+ * lookups the packagers made before, on the same parsed documents:
+ *
+ *   parse:   rapidjson's parse alone
+ *   helpers: parse, then a HasMember and a lookup per field, as before
+ *   client:  Client::get_*, answered from the response cache: reads the
+ *            cached body, parses it and decodes it with the field tables
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "autolab/autolab.h"
+#include "autolab/client.h"
+#include "json_helpers.h"
+
+#include "scratch_dir.h"
+#include "stand_in_server.h"
+
+const int num_elements = 10000;
+
+static std::string make_list(const std::function<std::string(const std::string &)> &element) {
+  std::string json("[");
+  for (int i = 0; i < num_elements; i++) {
+    if (i > 0) json.append(",");
+    json.append(element(std::to_string(i)));
+  }
+  json.append("]");
+  return json;
+}
+
+static std::string course_json(const std::string &id) {
+  return "{\"name\":\"course" + id + "\",\"display_name\":\"Course " + id + "\","
+    "\"semester\":\"f20\",\"late_slack\":0,\"grace_days\":5,\"auth_level\":\"student\"}";
+}
+
+static std::string assessment_json(const std::string &id) {
+  return "{\"name\":\"asmt" + id + "\",\"display_name\":\"Assessment " + id + "\","
+    "\"category_name\":\"Labs\",\"start_at\":\"2020-01-01T00:00:00.000-05:00\","
+    "\"due_at\":\"2020-02-01T00:00:00.000-05:00\","
+    "\"end_at\":\"2020-02-02T00:00:00.000-05:00\","
+    "\"grading_deadline\":\"2020-02-03T00:00:00.000-05:00\"}";
+}
+
+static std::string problem_json(const std::string &id) {
+  return "{\"name\":\"problem" + id + "\",\"description\":\"Problem " + id + "\","
+    "\"max_score\":10.0,\"optional\":false}";
+}
+
+/* the packagers before the field tables */
+
+static void course_from_helpers(Autolab::Course &course, rapidjson::Value &c_doc) {
+  course.name         = get_string_force(c_doc, "name");
+  course.display_name = get_string(c_doc, "display_name");
+  course.semester     = get_string(c_doc, "semester");
+  course.late_slack   = get_int(c_doc, "late_slack", 0);
+  course.grace_days   = get_int(c_doc, "grace_days", 0);
+  course.auth_level   = Autolab::Utility::string_to_authorization_level(
+      get_string_force(c_doc, "auth_level"));
+}
+
+static void assessment_from_helpers(Autolab::Assessment &asmt, rapidjson::Value &a_doc) {
+  asmt.name          = get_string_force(a_doc, "name");
+  asmt.display_name  = get_string(a_doc, "display_name");
+  asmt.category_name = get_string(a_doc, "category_name");
+  asmt.start_at = Autolab::Utility::string_to_time(get_string_force(a_doc, "start_at"));
+  asmt.due_at   = Autolab::Utility::string_to_time(get_string_force(a_doc, "due_at"));
+  asmt.end_at   = Autolab::Utility::string_to_time(get_string_force(a_doc, "end_at"));
+  asmt.grading_deadline = Autolab::Utility::string_to_time(get_string(a_doc, "grading_deadline"));
+}
+
+static void problem_from_helpers(Autolab::Problem &prob, rapidjson::Value &p_doc) {
+  prob.name        = get_string_force(p_doc, "name");
+  prob.description = get_string(p_doc, "description");
+  prob.max_score   = get_double(p_doc, "max_score");
+  prob.optional    = get_bool(p_doc, "optional", false);
+}
+
+template <typename T>
+static void decode_with_helpers(const std::string &json,
+  void (*from_helpers)(T &, rapidjson::Value &))
+{
+  rapidjson::Document doc;
+  doc.Parse(json.c_str(), json.length());
+  std::vector<T> results;
+  for (auto &element : doc.GetArray()) {
+    T result;
+    from_helpers(result, element);
+    results.push_back(result);
+  }
+}
+
+static void parse_only(const std::string &json) {
+  rapidjson::Document doc;
+  doc.Parse(json.c_str(), json.length());
+}
+
+// best time of a few runs, in milliseconds
+static double time_best(const std::function<void()> &run) {
+  double best = 0;
+  for (int i = 0; i < 5; i++) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+    if (i == 0 || elapsed.count() < best) best = elapsed.count();
+  }
+  return best;
+}
+
+static void report(const char *name, const std::string &json,
+  const std::function<void()> &helpers, const std::function<void()> &client)
+{
+  double parse = time_best([&json]() { parse_only(json); });
+  std::printf("%-12s %10.2f %10.2f %10.2f\n", name, parse, time_best(helpers),
+    time_best(client));
+}
+
+int main() {
+  stand_in_server server;
+  scratch_dir cache_dir("decode-bench");
+
+  std::string courses = make_list(course_json);
+  std::string asmts = make_list(assessment_json);
+  std::string probs = make_list(problem_json);
+  server.set_resource("/courses", courses);
+  server.set_resource("/assessments", asmts);
+  server.set_resource("/problems", probs);
+
+  // reads are answered from the cache after the first one
+  Autolab::Client client(server.base_uri(), "id", "secret", "uri",
+    (void (*)(std::string, std::string))nullptr);
+  client.set_tokens("access", "refresh");
+  client.set_ca_file(server.ca_file());
+  client.enable_response_cache(cache_dir.path());
+
+  std::printf("%d elements per list, best of 5 runs in ms\n", num_elements);
+  std::printf("%-12s %10s %10s %10s\n", "list", "parse", "helpers", "client");
+  report("courses", courses,
+    [&courses]() { decode_with_helpers(courses, course_from_helpers); },
+    [&client]() {
+      std::vector<Autolab::Course> results;
+      client.get_courses(results);
+    });
+  report("assessments", asmts,
+    [&asmts]() { decode_with_helpers(asmts, assessment_from_helpers); },
+    [&client]() {
+      std::vector<Autolab::Assessment> results;
+      client.get_assessments(results, "course");
+    });
+  report("problems", probs,
+    [&probs]() { decode_with_helpers(probs, problem_from_helpers); },
+    [&client]() {
+      std::vector<Autolab::Problem> results;
+      client.get_problems(results, "course", "asmt");
+    });
+
+  if (server.get_stats().requests != 3) {
+    std::fprintf(stderr, "reads were not answered from the cache\n");
+    return 1;
+  }
+  return 0;
+}
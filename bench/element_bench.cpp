@@ -0,0 +1,114 @@
+/*
+ * Decodes synthetic submission and enrollment lists of 1 to 50 MB the way
+ * streamed responses are: split into elements by json_array_splitter, fed in
+ * network-sized chunks, and each element decoded by the element packagers.
+ *
+ * Built once per json backend (element_bench_rapidjson, and
+ * element_bench_simdjson when configured with -Djson_backend=simdjson), from
+ * the same sources as libautolab, so that both can be compared in one build.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+#include "autolab/autolab.h"
+#include "element_packagers.h"
+#include "json_stream.h"
+
+static std::string make_submissions(size_t size) {
+  std::string json("[");
+  for (int version = 1; json.length() < size; version++) {
+    if (version > 1) json.append(",");
+    json.append("{\"version\":" + std::to_string(version) +
+      ",\"created_at\":\"2020-01-15T12:34:56.000-05:00\""
+      ",\"filename\":\"student@example.com_" + std::to_string(version) + "_handin.tar\""
+      ",\"scores\":{");
+    for (int problem = 0; problem < 8; problem++) {
+      if (problem > 0) json.append(",");
+      json.append("\"Problem " + std::to_string(problem) + "\":" +
+        (problem == 7 ? std::string("null") : std::to_string(version % 10) + ".5"));
+    }
+    json.append("}}");
+  }
+  json.append("]");
+  return json;
+}
+
+static std::string make_enrollments(size_t size) {
+  std::string json("[");
+  for (int i = 0; json.length() < size; i++) {
+    if (i > 0) json.append(",");
+    std::string id = std::to_string(i);
+    json.append("{\"lecture\":\"1\",\"section\":\"A\",\"grade_policy\":\"\","
+      "\"nickname\":\"student" + id + "\",\"dropped\":false,"
+      "\"auth_level\":\"student\",\"first_name\":\"First" + id + "\","
+      "\"last_name\":\"Last" + id + "\",\"email\":\"student" + id + "@example.com\","
+      "\"school\":\"SCS\",\"major\":\"CS\",\"year\":\"2\"}");
+  }
+  json.append("]");
+  return json;
+}
+
+// best time of a few runs, in seconds. Elements are fed in 16 KB chunks, like
+// the bodies received by curl. reset is called before each run.
+static double time_decode(const std::string &json,
+  const Autolab::json_array_splitter::element_callback &decode,
+  const std::function<void()> &reset, size_t &elements)
+{
+  const size_t chunk = 16 * 1024;
+  double best = 0;
+  for (int run = 0; run < 3; run++) {
+    reset();
+    elements = 0;
+    std::string fallback;
+    Autolab::json_array_splitter splitter(
+      [&decode, &elements](const char *data, size_t length) {
+        decode(data, length);
+        elements++;
+      }, fallback);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < json.length(); offset += chunk) {
+      splitter.feed(json.data() + offset, std::min(chunk, json.length() - offset));
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (!splitter.complete()) {
+      std::fprintf(stderr, "payload was not a complete array\n");
+      std::exit(1);
+    }
+    if (run == 0 || elapsed.count() < best) best = elapsed.count();
+  }
+  return best;
+}
+
+int main() {
+  const size_t sizes_mb[] = {1, 5, 10, 25, 50};
+
+  std::printf("backend: %s\n", ELEMENT_BACKEND);
+  std::printf("%-12s %8s %10s %10s %10s\n", "payload", "MB", "elements", "ms", "MB/s");
+  for (size_t mb : sizes_mb) {
+    size_t size = mb * 1024 * 1024;
+    size_t elements;
+
+    std::string subs = make_submissions(size);
+    Autolab::ScoreMatrix scores;
+    double seconds = time_decode(subs, [&scores](const char *json, size_t length) {
+      Autolab::submission_from_json_text(scores, json, length);
+    }, [&scores]() { scores.clear(); }, elements);
+    std::printf("%-12s %8zu %10zu %10.1f %10.1f\n", "submissions", mb, elements,
+      seconds * 1000, subs.length() / seconds / (1024 * 1024));
+
+    std::string enrolls = make_enrollments(size);
+    Autolab::Enrollment enrollment;
+    seconds = time_decode(enrolls, [&enrollment](const char *json, size_t length) {
+      Autolab::enrollment_from_json_text(enrollment, json, length);
+    }, []() {}, elements);
+    std::printf("%-12s %8zu %10zu %10.1f %10.1f\n", "enrollments", mb, elements,
+      seconds * 1000, enrolls.length() / seconds / (1024 * 1024));
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Counts the TLS handshakes the requests of a few commands cost, against the
+ * local stand-in server:
+ *
+ *   per request: every request uses a client of its own, as when RawClient
+ *                made a new easy handle for each request
+ *   per command: one client for the requests of a command, as in a single
+ *                run of autolab
+ *   daemon:      one client for every command, as when they are forwarded to
+ *                a running 'autolab daemon'
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "autolab/autolab.h"
+#include "autolab/client.h"
+
+#include "stand_in_server.h"
+
+// a request made by a command. Consecutive batched steps are performed
+// concurrently, as the command does with begin_batch and end_batch.
+struct step {
+  void (*run)(Autolab::Client &client);
+  bool batched;
+};
+
+// the results of batched requests are only filled in by end_batch, after the
+// step has returned
+static void get_problems(Autolab::Client &client) {
+  static std::vector<Autolab::Problem> problems;
+  problems.clear();
+  client.get_problems(problems, "course", "asmt");
+}
+
+static void get_submissions(Autolab::Client &client) {
+  static std::vector<Autolab::Submission> subs;
+  subs.clear();
+  client.get_submissions(subs, "course", "asmt");
+}
+
+static void get_feedback(Autolab::Client &client) {
+  std::string feedback;
+  client.get_feedback(feedback, "course", "asmt", 1, "p1");
+}
+
+static void get_assessment_details(Autolab::Client &client) {
+  Autolab::DetailedAssessment dasmt;
+  client.get_assessment_details(dasmt, "course", "asmt");
+}
+
+struct command {
+  const char *name;
+  std::vector<step> steps;
+};
+
+static const std::vector<command> commands = {
+  {"status",        {{get_assessment_details, false}}},
+  {"scores",        {{get_problems, true}, {get_submissions, true}}},
+  {"feedback",      {{get_submissions, true}, {get_problems, true}, {get_feedback, false}}},
+  // three polls, then the problem names for the table
+  {"submit --wait", {{get_submissions, false}, {get_submissions, false},
+                     {get_submissions, false}, {get_problems, false}}},
+};
+
+enum client_scope {client_per_request, client_per_command, client_per_daemon};
+
+static std::unique_ptr<Autolab::Client> new_client(stand_in_server &server) {
+  std::unique_ptr<Autolab::Client> client(new Autolab::Client(server.base_uri(),
+    "id", "secret", "uri", (void (*)(std::string, std::string))nullptr));
+  client->set_tokens("access", "refresh");
+  client->set_ca_file(server.ca_file());
+  return client;
+}
+
+static void run_command(stand_in_server &server, const command &cmd,
+  client_scope scope, std::unique_ptr<Autolab::Client> &shared)
+{
+  if (scope == client_per_request) {
+    for (const step &s : cmd.steps) {
+      s.run(*new_client(server));
+    }
+    return;
+  }
+
+  if (scope == client_per_command || !shared) shared = new_client(server);
+  Autolab::Client &client = *shared;
+  bool batching = false;
+  for (const step &s : cmd.steps) {
+    if (s.batched && !batching) client.begin_batch();
+    if (!s.batched && batching) client.end_batch();
+    batching = s.batched;
+    s.run(client);
+  }
+  if (batching) client.end_batch();
+}
+
+int main() {
+  const int rounds = 20;
+  const char *scope_names[] = {"per request", "per command", "daemon"};
+
+  stand_in_server server;
+  server.set_resource("/assessments/asmt",
+    "{\"name\":\"asmt\",\"display_name\":\"Asmt\",\"category_name\":\"Labs\","
+    "\"start_at\":\"2020-01-01T00:00:00.000-05:00\","
+    "\"due_at\":\"2020-02-01T00:00:00.000-05:00\","
+    "\"end_at\":\"2020-02-02T00:00:00.000-05:00\","
+    "\"grading_deadline\":\"2020-02-03T00:00:00.000-05:00\","
+    "\"handout_format\":\"none\",\"writeup_format\":\"none\"}");
+  server.set_resource("/problems",
+    "[{\"name\":\"p1\",\"max_score\":10.0},{\"name\":\"p2\",\"max_score\":5.0}]");
+  server.set_resource("/submissions",
+    "[{\"version\":1,\"created_at\":\"2020-01-15T12:00:00.000-05:00\","
+    "\"filename\":\"handin.tar\",\"scores\":{\"p1\":7.5,\"p2\":5.0}}]");
+  server.set_resource("/feedback", "{\"feedback\":\"Good job.\"}");
+
+  std::printf("%-14s %-12s %10s %10s %10s %10s\n", "command", "client",
+    "requests", "handshakes", "resumed", "ms");
+  for (const command &cmd : commands) {
+    for (client_scope scope : {client_per_request, client_per_command, client_per_daemon}) {
+      std::unique_ptr<Autolab::Client> shared;
+      server.reset_stats();
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < rounds; i++) {
+        run_command(server, cmd, scope, shared);
+      }
+      std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+      stand_in_server::stats stats = server.get_stats();
+      std::printf("%-14s %-12s %10.1f %10.1f %10.1f %10.2f\n", cmd.name,
+        scope_names[scope], (double)stats.requests / rounds,
+        (double)stats.handshakes / rounds,
+        (double)stats.resumed_handshakes / rounds, elapsed.count() / rounds);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Checks the conditional requests made for cached responses against the
+ * local stand-in server: a read of a cached response sends the validators the
+ * server gave for it, and a 304 Not Modified answer is served from the cache,
+ * while a changed response is received again.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "autolab/autolab.h"
+#include "autolab/client.h"
+
+#include "scratch_dir.h"
+#include "stand_in_server.h"
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what) {
+  std::printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+  if (!ok) failures++;
+}
+
+static const char *course_v1 =
+  "[{\"name\":\"course\",\"display_name\":\"Course\",\"auth_level\":\"student\"}]";
+static const char *course_v2 =
+  "[{\"name\":\"course\",\"display_name\":\"Renamed\",\"auth_level\":\"student\"}]";
+static const char *problems =
+  "[{\"name\":\"p1\",\"max_score\":10.0},{\"name\":\"p2\",\"max_score\":5.0}]";
+static const char *submissions =
+  "[{\"version\":1,\"created_at\":\"2020-01-15T12:00:00.000-05:00\","
+  "\"filename\":\"handin.tar\",\"scores\":{\"p1\":7.5,\"p2\":5.0}},"
+  "{\"version\":2,\"created_at\":\"2020-01-16T12:00:00.000-05:00\","
+  "\"filename\":\"handin.tar\",\"scores\":{\"p1\":10.0,\"p2\":4.0}}]";
+static const char *last_modified = "Wed, 15 Jan 2020 17:00:00 GMT";
+
+int main() {
+  stand_in_server server;
+  scratch_dir cache_dir("revalidation-check");
+
+  Autolab::Client client(server.base_uri(), "id", "secret", "uri",
+    (void (*)(std::string, std::string))nullptr);
+  client.set_tokens("access", "refresh");
+  client.set_ca_file(server.ca_file());
+  client.enable_response_cache(cache_dir.path());
+  // every read goes to the server, with the validators of the cached response
+  client.set_cache_bypass(true);
+
+  /* ETag */
+  server.set_resource("/courses", course_v1, "\"v1\"");
+  std::vector<Autolab::Course> courses;
+  client.get_courses(courses);
+  stand_in_server::stats stats = server.get_stats();
+  expect(stats.requests == 1 && stats.not_modified == 0 &&
+    stats.last_if_none_match.empty(), "first read is unconditional");
+
+  courses.clear();
+  client.get_courses(courses);
+  stats = server.get_stats();
+  expect(stats.last_if_none_match == "\"v1\"", "cached ETag is sent as If-None-Match");
+  expect(stats.not_modified == 1, "unchanged response is answered with 304");
+  expect(courses.size() == 1 && courses[0].display_name == "Course",
+    "304 is served from the cache");
+
+  server.set_resource("/courses", course_v2, "\"v2\"");
+  courses.clear();
+  client.get_courses(courses);
+  stats = server.get_stats();
+  expect(stats.not_modified == 1, "changed response is not answered with 304");
+  expect(courses.size() == 1 && courses[0].display_name == "Renamed",
+    "changed response is received again");
+
+  courses.clear();
+  client.get_courses(courses);
+  stats = server.get_stats();
+  expect(stats.last_if_none_match == "\"v2\"" && stats.not_modified == 2,
+    "ETag of the changed response replaces the cached one");
+
+  /* Last-Modified */
+  server.set_resource("/problems", problems, "", last_modified);
+  server.reset_stats();
+  std::vector<Autolab::Problem> probs;
+  client.get_problems(probs, "course", "asmt");
+  probs.clear();
+  client.get_problems(probs, "course", "asmt");
+  stats = server.get_stats();
+  expect(stats.requests == 2 && stats.not_modified == 1,
+    "cached Last-Modified is sent as If-Modified-Since");
+  expect(probs.size() == 2 && probs[1].name == "p2", "304 is served from the cache");
+
+  /* streamed elements */
+  server.set_resource("/submissions", submissions, "\"s1\"");
+  server.reset_stats();
+  Autolab::ScoreMatrix scores;
+  client.get_submissions(scores, "course", "asmt");
+  scores.clear();
+  client.get_submissions(scores, "course", "asmt");
+  stats = server.get_stats();
+  expect(stats.not_modified == 1, "unchanged list is answered with 304");
+  expect(scores.num_submissions() == 2 && scores.version(1) == 2 &&
+    scores.num_problems() == 2, "elements of a 304 are streamed from the cache");
+
+  /* batched reads */
+  server.reset_stats();
+  courses.clear();
+  probs.clear();
+  client.begin_batch();
+  client.get_courses(courses);
+  client.get_problems(probs, "course", "asmt");
+  client.end_batch();
+  stats = server.get_stats();
+  expect(stats.requests == 2 && stats.not_modified == 2,
+    "batched reads are conditional too");
+  expect(courses.size() == 1 && probs.size() == 2,
+    "batched 304s are served from the cache");
+
+  return failures > 0 ? 1 : 0;
+}
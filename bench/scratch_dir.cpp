@@ -0,0 +1,37 @@
+#include "scratch_dir.h"
+
+#include <dirent.h>
+#include <stdlib.h>   // mkdtemp, getenv
+#include <sys/stat.h> // lstat
+#include <unistd.h>   // rmdir, unlink
+
+#include <stdexcept>
+
+scratch_dir::scratch_dir(const char *prefix) {
+  const char *tmpdir = getenv("TMPDIR");
+  dir = std::string(tmpdir ? tmpdir : "/tmp") + "/" + prefix + ".XXXXXX";
+  if (!mkdtemp(&dir[0])) {
+    throw std::runtime_error("cannot create a directory in " + dir);
+  }
+}
+
+// removes dir and everything in it
+static void remove_tree(const std::string &dir) {
+  DIR *entries = opendir(dir.c_str());
+  if (!entries) return;
+  struct dirent *entry;
+  while ((entry = readdir(entries))) {
+    std::string name(entry->d_name);
+    if (name == "." || name == "..") continue;
+    std::string path = dir + "/" + name;
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) remove_tree(path);
+    else unlink(path.c_str());
+  }
+  closedir(entries);
+  rmdir(dir.c_str());
+}
+
+scratch_dir::~scratch_dir() {
+  remove_tree(dir);
+}
@@ -0,0 +1,27 @@
+/*
+ * A temporary directory for a benchmark's or check's files, e.g. a response
+ * cache or a home directory, removed with everything in it when it goes out
+ * of scope.
+ */
+
+#ifndef BENCH_SCRATCH_DIR_H_
+#define BENCH_SCRATCH_DIR_H_
+
+#include <string>
+
+class scratch_dir {
+public:
+  // named after prefix, in $TMPDIR or /tmp
+  explicit scratch_dir(const char *prefix);
+  ~scratch_dir();
+
+  scratch_dir(const scratch_dir &) = delete;
+  scratch_dir &operator=(const scratch_dir &) = delete;
+
+  const std::string &path() const { return dir; }
+
+private:
+  std::string dir;
+};
+
+#endif /* BENCH_SCRATCH_DIR_H_ */
@@ -0,0 +1,286 @@
+#include "stand_in_server.h"
+
+#include <arpa/inet.h>  // htonl, htons
+#include <netinet/in.h> // sockaddr_in
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>      // fdopen
+#include <stdlib.h>     // mkstemp, getenv
+#include <strings.h>    // strncasecmp
+#include <sys/socket.h>
+#include <unistd.h>     // close, unlink
+
+#include <cstring>
+#include <stdexcept>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    ERR_print_errors_fp(stderr);
+    throw std::runtime_error(std::string("stand-in server: ") + what);
+  }
+}
+
+stand_in_server::stand_in_server() : ctx(nullptr), listen_fd(-1), port(0),
+  stopping(false), counts()
+{
+  // a client that hangs up mid-response must not stop the process
+  signal(SIGPIPE, SIG_IGN);
+
+  ctx = SSL_CTX_new(TLS_server_method());
+  check(ctx != nullptr, "SSL_CTX_new");
+  make_certificate();
+
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  check(listen_fd >= 0, "socket");
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0; // any free port
+  socklen_t addr_len = sizeof(addr);
+  check(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        listen(listen_fd, 64) == 0 &&
+        getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) == 0, "listen");
+  port = ntohs(addr.sin_port);
+
+  acceptor = std::thread(&stand_in_server::accept_loop, this);
+}
+
+stand_in_server::~stand_in_server() {
+  stopping = true;
+  acceptor.join();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    // wakes the connections waiting for their next request
+    for (int fd : connection_fds) shutdown(fd, SHUT_RDWR);
+  }
+  for (auto &connection : connections) connection.join();
+  for (int fd : connection_fds) close(fd);
+  close(listen_fd);
+  SSL_CTX_free(ctx);
+  unlink(cert_file.c_str());
+}
+
+std::string stand_in_server::base_uri() const {
+  return "https://127.0.0.1:" + std::to_string(port);
+}
+
+void stand_in_server::set_resource(const std::string &suffix,
+  const std::string &body, const std::string &etag,
+  const std::string &last_modified)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  resources[suffix] = {body, etag, last_modified};
+}
+
+stand_in_server::stats stand_in_server::get_stats() {
+  std::lock_guard<std::mutex> guard(lock);
+  return counts;
+}
+
+void stand_in_server::reset_stats() {
+  std::lock_guard<std::mutex> guard(lock);
+  counts = stats();
+}
+
+/* certificate */
+
+static void add_extension(X509 *cert, int nid, const char *value) {
+  X509V3_CTX v3;
+  X509V3_set_ctx_nodb(&v3);
+  X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+  X509_EXTENSION *ext = X509V3_EXT_conf_nid(nullptr, &v3, nid, (char *)value);
+  check(ext != nullptr, "X509V3_EXT_conf_nid");
+  X509_add_ext(cert, ext, -1);
+  X509_EXTENSION_free(ext);
+}
+
+// A self-signed certificate for 127.0.0.1, which the client is given as its
+// only trusted one. Written to a temporary file for RawClient::set_ca_file.
+void stand_in_server::make_certificate() {
+  EVP_PKEY *key = nullptr;
+  EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  check(key_ctx != nullptr && EVP_PKEY_keygen_init(key_ctx) > 0 &&
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) > 0 &&
+        EVP_PKEY_keygen(key_ctx, &key) > 0, "key generation");
+  EVP_PKEY_CTX_free(key_ctx);
+
+  X509 *cert = X509_new();
+  check(cert != nullptr, "X509_new");
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), -60 * 60);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+    (const unsigned char *)"127.0.0.1", -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  add_extension(cert, NID_basic_constraints, "critical,CA:TRUE");
+  add_extension(cert, NID_key_usage, "critical,keyCertSign,digitalSignature");
+  add_extension(cert, NID_subject_alt_name, "IP:127.0.0.1");
+  check(X509_sign(cert, key, EVP_sha256()) > 0, "X509_sign");
+
+  check(SSL_CTX_use_certificate(ctx, cert) == 1 &&
+        SSL_CTX_use_PrivateKey(ctx, key) == 1, "SSL_CTX_use_certificate");
+
+  const char *tmpdir = getenv("TMPDIR");
+  std::string name_template(tmpdir ? tmpdir : "/tmp");
+  name_template.append("/stand-in-cert.XXXXXX");
+  int fd = mkstemp(&name_template[0]);
+  check(fd >= 0, "mkstemp");
+  cert_file = name_template;
+  FILE *file = fdopen(fd, "w");
+  check(file != nullptr && PEM_write_X509(file, cert) == 1, "PEM_write_X509");
+  fclose(file);
+
+  X509_free(cert);
+  EVP_PKEY_free(key);
+}
+
+/* connections */
+
+void stand_in_server::accept_loop() {
+  struct pollfd pfd = {listen_fd, POLLIN, 0};
+  while (!stopping) {
+    // checks for stopping at least every 100ms
+    if (poll(&pfd, 1, 100) <= 0) continue;
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) continue;
+
+    std::lock_guard<std::mutex> guard(lock);
+    connection_fds.push_back(fd);
+    connections.emplace_back(&stand_in_server::serve_connection, this, fd);
+  }
+}
+
+void stand_in_server::serve_connection(int fd) {
+  SSL *ssl = SSL_new(ctx);
+  SSL_set_fd(ssl, fd);
+  if (SSL_accept(ssl) == 1) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      counts.handshakes++;
+      if (SSL_session_reused(ssl)) counts.resumed_handshakes++;
+    }
+
+    std::string received;
+    char buffer[16 * 1024];
+    bool open = true;
+    while (open) {
+      size_t head_end = received.find("\r\n\r\n");
+      if (head_end == std::string::npos) {
+        int amount = SSL_read(ssl, buffer, sizeof(buffer));
+        if (amount <= 0) break;
+        received.append(buffer, amount);
+        continue;
+      }
+
+      std::string head = received.substr(0, head_end + 2);
+      received.erase(0, head_end + 4);
+      // request bodies (posted parameters) are read and ignored
+      const char *length_header = strcasestr(head.c_str(), "\r\nContent-Length:");
+      size_t body_length = length_header ? strtoul(length_header + 17, nullptr, 10) : 0;
+      while (open && received.length() < body_length) {
+        int amount = SSL_read(ssl, buffer, sizeof(buffer));
+        if (amount <= 0) open = false;
+        else received.append(buffer, amount);
+      }
+      if (!open) break;
+      received.erase(0, body_length);
+
+      open = respond(ssl, head);
+    }
+    SSL_shutdown(ssl);
+  }
+  SSL_free(ssl);
+  // the fd is closed by the destructor, after every connection has stopped,
+  // so that it isn't reused by another connection while still listed
+  shutdown(fd, SHUT_RDWR);
+}
+
+// value of the header called name in head, empty if there is none
+static std::string header_value(const std::string &head, const char *name) {
+  size_t name_length = std::strlen(name);
+  size_t line = head.find("\r\n");
+  while (line != std::string::npos && line + 2 < head.length()) {
+    size_t start = line + 2;
+    size_t end = head.find("\r\n", start);
+    if (end - start > name_length && head[start + name_length] == ':' &&
+        strncasecmp(head.c_str() + start, name, name_length) == 0) {
+      size_t value = head.find_first_not_of(' ', start + name_length + 1);
+      return head.substr(value, end - value);
+    }
+    line = end;
+  }
+  return std::string();
+}
+
+bool stand_in_server::respond(SSL *ssl, const std::string &head) {
+  // "GET /api/v1/courses?access_token=... HTTP/1.1"
+  size_t path_start = head.find(' ') + 1;
+  size_t path_end = head.find_first_of(" ?", path_start);
+  std::string path = head.substr(path_start, path_end - path_start);
+  std::string if_none_match = header_value(head, "If-None-Match");
+  std::string if_modified_since = header_value(head, "If-Modified-Since");
+
+  std::string response;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    counts.requests++;
+    counts.last_if_none_match = if_none_match;
+
+    const resource *found = nullptr;
+    for (auto &entry : resources) {
+      const std::string &suffix = entry.first;
+      if (path.length() >= suffix.length() &&
+          path.compare(path.length() - suffix.length(), suffix.length(), suffix) == 0) {
+        found = &entry.second;
+      }
+    }
+
+    if (!found) {
+      std::string body = "{\"error\":\"Not found\"}";
+      response = "HTTP/1.1 404 Not Found\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: " + std::to_string(body.length()) + "\r\n\r\n" + body;
+    } else {
+      std::string validators;
+      if (found->etag.length() > 0) {
+        validators += "ETag: " + found->etag + "\r\n";
+      }
+      if (found->last_modified.length() > 0) {
+        validators += "Last-Modified: " + found->last_modified + "\r\n";
+      }
+      // If-None-Match takes precedence, as in RFC 7232
+      bool not_modified = if_none_match.length() > 0 ?
+        if_none_match == found->etag :
+        if_modified_since.length() > 0 && if_modified_since == found->last_modified;
+
+      if (not_modified) {
+        counts.not_modified++;
+        response = "HTTP/1.1 304 Not Modified\r\n" + validators + "\r\n";
+      } else {
+        counts.body_bytes += found->body.length();
+        response = "HTTP/1.1 200 OK\r\n"
+          "Content-Type: application/json\r\n"
+          "Content-Length: " + std::to_string(found->body.length()) + "\r\n" +
+          validators + "\r\n" + found->body;
+      }
+    }
+  }
+
+  size_t written = 0;
+  while (written < response.length()) {
+    int amount = SSL_write(ssl, response.data() + written,
+      (int)(response.length() - written));
+    if (amount <= 0) return false;
+    written += amount;
+  }
+  return strcasestr(head.c_str(), "\r\nConnection: close") == nullptr;
+}
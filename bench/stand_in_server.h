@@ -0,0 +1,82 @@
+/*
+ * A local HTTPS stand-in for the Autolab API, used by the benchmarks and the
+ * checks in this directory.
+ *
+ * It listens on an ephemeral port of 127.0.0.1 with a self-signed certificate
+ * made at startup, and answers each request with the resource whose suffix
+ * matches the request path. Resources with an ETag or a Last-Modified date are
+ * answered with 304 Not Modified when the request's validators still match.
+ * Connections are kept alive, and the TLS handshakes are counted, so that the
+ * benchmarks can show how many each command costs.
+ */
+
+#ifndef BENCH_STAND_IN_SERVER_H_
+#define BENCH_STAND_IN_SERVER_H_
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+class stand_in_server {
+public:
+  stand_in_server();
+  ~stand_in_server();
+
+  stand_in_server(const stand_in_server &) = delete;
+  stand_in_server &operator=(const stand_in_server &) = delete;
+
+  // e.g. https://127.0.0.1:43210, for the client's domain
+  std::string base_uri() const;
+  // the certificate, for RawClient::set_ca_file
+  const std::string &ca_file() const { return cert_file; }
+
+  // Answers requests whose path (without the query) ends with suffix. Empty
+  // validators are not sent, and not checked.
+  void set_resource(const std::string &suffix, const std::string &body,
+    const std::string &etag = "", const std::string &last_modified = "");
+
+  struct stats {
+    long handshakes;
+    long resumed_handshakes;
+    long requests;
+    long not_modified;
+    long long body_bytes;
+    // the If-None-Match header of the last request, empty if none
+    std::string last_if_none_match;
+  };
+  stats get_stats();
+  void reset_stats();
+
+private:
+  struct resource {
+    std::string body;
+    std::string etag;
+    std::string last_modified;
+  };
+
+  SSL_CTX *ctx;
+  int listen_fd;
+  int port;
+  std::string cert_file;
+  std::atomic<bool> stopping;
+  std::thread acceptor;
+
+  std::mutex lock;
+  std::map<std::string, resource> resources;
+  stats counts;
+  std::vector<std::thread> connections;
+  std::vector<int> connection_fds;
+
+  void make_certificate();
+  void accept_loop();
+  void serve_connection(int fd);
+  // writes the response to one request, returns false to close the connection
+  bool respond(SSL *ssl, const std::string &head);
+};
+
+#endif /* BENCH_STAND_IN_SERVER_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Times the startup of the autolab binary for commands that never need the
+ * network: the help texts, the version, and the shell completion. Each is run
+ * as a new process, with HOME set to a scratch directory holding a token
+ * cache, so that the commands that want a user set up find one.
+ *
+ * When strace was found at configure time, the system calls of one run of
+ * each are counted too.
+ */
+
+#include <fcntl.h>    // open
+#include <stdlib.h>   // setenv
+#include <sys/stat.h> // mkdir
+#include <sys/wait.h> // waitpid
+#include <unistd.h>   // fork, execv, dup2
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "scratch_dir.h"
+
+// runs the program with args, its output discarded. Returns whether it ran.
+static bool run(const std::vector<std::string> &args) {
+  std::vector<char *> argv;
+  for (const std::string &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  pid_t pid = fork();
+  if (pid < 0) return false;
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_RDWR);
+    dup2(null_fd, STDIN_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+    WEXITSTATUS(status) != 127;
+}
+
+// median of a few runs, in milliseconds
+static double time_startup(const std::vector<std::string> &args) {
+  const int runs = 21;
+  std::vector<double> times;
+  for (int i = 0; i < runs; i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (!run(args)) return -1;
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+    times.push_back(elapsed.count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[runs / 2];
+}
+
+// system calls of one run, from the "total" line of strace -c, or -1
+static long count_syscalls(const std::vector<std::string> &args,
+  const std::string &output_file)
+{
+  std::string strace(STRACE);
+  if (strace.empty()) return -1;
+
+  std::vector<std::string> traced = {strace, "-f", "-c", "-o", output_file};
+  traced.insert(traced.end(), args.begin(), args.end());
+  if (!run(traced)) return -1;
+
+  // "100.00    0.001234           5       250        12 total"
+  std::ifstream summary(output_file);
+  std::string line;
+  while (std::getline(summary, line)) {
+    std::istringstream columns(line);
+    std::string percent, seconds, usecs;
+    long calls;
+    if (line.find("total") != std::string::npos &&
+        columns >> percent >> seconds >> usecs >> calls) {
+      return calls;
+    }
+  }
+  return -1;
+}
+
+int main() {
+  const std::string autolab(AUTOLAB_BINARY);
+  const std::vector<std::vector<std::string>> commands = {
+    {"-h"},
+    {"--version"},
+    {"courses", "-h"},
+    {"__complete", "autolab cou"},
+    {"__complete", "autolab scores --"},
+  };
+
+  scratch_dir home("startup-bench");
+  setenv("HOME", home.path().c_str(), 1);
+  // a token cache, never decrypted by these commands
+  mkdir((home.path() + "/.autolab").c_str(), 0700);
+  std::ofstream(home.path() + "/.autolab/.arcache") << "placeholder";
+
+  std::printf("%-40s %10s %10s\n", "command", "ms", "syscalls");
+  for (const std::vector<std::string> &command : commands) {
+    std::vector<std::string> args = {autolab};
+    args.insert(args.end(), command.begin(), command.end());
+    std::string name = "autolab";
+    for (const std::string &arg : command) name += " " + arg;
+
+    double ms = time_startup(args);
+    if (ms < 0) {
+      std::fprintf(stderr, "cannot run %s\n", autolab.c_str());
+      return 1;
+    }
+    long syscalls = count_syscalls(args, home.path() + "/strace.out");
+    if (syscalls >= 0) {
+      std::printf("%-40s %10.2f %10ld\n", name.c_str(), ms, syscalls);
+    } else {
+      std::printf("%-40s %10.2f %10s\n", name.c_str(), ms, "-");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Times Utility::string_to_time against the sscanf and mktime parser it
+ * replaced, on the timestamps of a submissions list, and counts the
+ * timestamps on which they disagree. The previous parser ignored the minutes
+ * of the offset, and the local daylight saving time of the parsed date, so
+ * only whole-hour offsets are expected to agree, and only outside of a
+ * daylight saving time change.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "autolab/autolab.h"
+
+/* the parser before the days-from-civil one */
+
+static double get_timezone_offset() {
+  std::time_t raw_time_utc;
+  std::time(&raw_time_utc);
+
+  std::tm *utc = std::gmtime(&raw_time_utc);
+  utc->tm_isdst = -1;
+  std::time_t raw_time_local = std::mktime(utc);
+
+  double diff_in_seconds = std::difftime(raw_time_utc, raw_time_local);
+  return diff_in_seconds / 3600; // convert seconds to hours
+}
+
+static std::time_t sscanf_string_to_time(std::string str_time) {
+  std::tm tms;
+  int source_timezone_offset = 0;
+
+  int res = std::sscanf(str_time.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d.%*3c%3d",
+    &tms.tm_year, &tms.tm_mon, &tms.tm_mday,
+    &tms.tm_hour, &tms.tm_min, &tms.tm_sec,
+    &source_timezone_offset);
+  if (res != 7) return 0;
+
+  tms.tm_isdst = -1;
+  tms.tm_year -= 1900;
+  tms.tm_mon -= 1;
+
+  int net_timezone_offset = source_timezone_offset - get_timezone_offset();
+  std::time_t raw_src_time = std::mktime(&tms);
+  std::chrono::system_clock::time_point src_time =
+      std::chrono::system_clock::from_time_t(raw_src_time);
+  src_time -= std::chrono::hours(net_timezone_offset);
+  return std::chrono::system_clock::to_time_t(src_time);
+}
+
+// created_at of a list of submissions, spread over a year in a few time zones
+static std::vector<std::string> make_timestamps(size_t count) {
+  const char *offsets[] = {"-05:00", "-04:00", "+00:00", "+09:00"};
+  std::vector<std::string> timestamps;
+  char buffer[64];
+  for (size_t i = 0; i < count; i++) {
+    std::snprintf(buffer, sizeof(buffer), "2020-%02zu-%02zuT%02zu:%02zu:%02zu.%03zu%s",
+      i % 12 + 1, i % 28 + 1, i % 24, i % 60, (i * 7) % 60, i % 1000,
+      offsets[i % 4]);
+    timestamps.push_back(buffer);
+  }
+  return timestamps;
+}
+
+// best time of a few runs, in nanoseconds per timestamp
+static double time_parser(const std::vector<std::string> &timestamps,
+  const std::function<std::time_t(const std::string &)> &parse)
+{
+  double best = 0;
+  for (int run = 0; run < 5; run++) {
+    std::time_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string &timestamp : timestamps) sum += parse(timestamp);
+    std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+    // keeps the parsing from being optimized away
+    if (sum == 1) std::printf(" ");
+    double per_timestamp = elapsed.count() / timestamps.size();
+    if (run == 0 || per_timestamp < best) best = per_timestamp;
+  }
+  return best;
+}
+
+int main() {
+  const size_t count = 100000;
+  std::vector<std::string> timestamps = make_timestamps(count);
+
+  size_t differing = 0;
+  for (const std::string &timestamp : timestamps) {
+    if (Autolab::Utility::string_to_time(timestamp) != sscanf_string_to_time(timestamp)) {
+      differing++;
+    }
+  }
+
+  double sscanf_ns = time_parser(timestamps, sscanf_string_to_time);
+  double parser_ns = time_parser(timestamps, [](const std::string &timestamp) {
+    return Autolab::Utility::string_to_time(timestamp.data(), timestamp.length());
+  });
+
+  std::printf("%zu timestamps, best of 5 runs\n", count);
+  std::printf("%-16s %10s\n", "parser", "ns each");
+  std::printf("%-16s %10.1f\n", "sscanf, mktime", sscanf_ns);
+  std::printf("%-16s %10.1f\n", "days-from-civil", parser_ns);
+  std::printf("speedup: %.1fx, %zu timestamps differ\n", sscanf_ns / parser_ns, differing);
+  return 0;
+}
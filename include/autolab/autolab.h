@@ -6,6 +6,7 @@
 #ifndef LIBAUTOLAB_AUTOLAB_H_
 #define LIBAUTOLAB_AUTOLAB_H_
 
+#include <cstddef>
 #include <ctime>
 
 #include <map>
@@ -91,6 +92,59 @@ struct Submission {
   std::map<std::string, double> scores;
 };
 
+// Scores of many submissions as a matrix with one row per submission and one
+// column per problem. Problem names are stored once, and the scores of a
+// submission are contiguous, so rows can be summed without lookups. A NaN score
+// means it's unreleased, or that the submission has no score for the problem.
+class ScoreMatrix {
+public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  ScoreMatrix() : stride(0) {}
+
+  size_t num_submissions() const { return versions.size(); }
+  size_t num_problems() const { return problem_names.size(); }
+  const std::string &problem_name(size_t col) const { return problem_names[col]; }
+
+  // column of the problem, or npos if none of the submissions has it.
+  size_t find_problem(const std::string &name) const;
+  // column of the problem, adding it (with NaN scores) if necessary. hint is
+  // the column the problem is expected in, which is checked first.
+  size_t intern_problem(const char *name, size_t length, size_t hint = 0);
+
+  // adds a submission with NaN scores and returns its row.
+  size_t add_submission(int version, std::time_t created_at, const std::string &filename);
+  void set_submission(size_t row, int version, std::time_t created_at, const std::string &filename);
+  // removes the row added last, and the problems added after it
+  void remove_last_submission();
+  void clear();
+
+  int version(size_t row) const { return versions[row]; }
+  std::time_t created_at(size_t row) const { return created_ats[row]; }
+  const std::string &filename(size_t row) const { return filenames[row]; }
+
+  double score(size_t row, size_t col) const { return cells[row * stride + col]; }
+  void set_score(size_t row, size_t col, double score) { cells[row * stride + col] = score; }
+  // the num_problems() scores of a submission
+  const double *scores(size_t row) const { return cells.data() + row * stride; }
+
+  // sum of the released scores of a submission
+  double total(size_t row) const;
+  bool has_released_scores(size_t row) const;
+
+private:
+  std::vector<std::string> problem_names;
+  std::vector<int> versions;
+  std::vector<std::time_t> created_ats;
+  std::vector<std::string> filenames;
+  // number of problems when each row was added
+  std::vector<size_t> row_num_problems;
+  // row-major, stride columns are allocated per row. stride is 0 or a
+  // multiple of 8, and the unused columns hold NaN.
+  std::vector<double> cells;
+  size_t stride;
+};
+
 struct User {
   std::string first_name;
   std::string last_name;
@@ -171,6 +225,7 @@ public:
 namespace Utility {
 // string conversions
 std::time_t string_to_time(std::string str);
+std::time_t string_to_time(const char *str, size_t length);
 AuthorizationLevel string_to_authorization_level(std::string str);
 std::string authorization_level_to_string(AuthorizationLevel auth_level);
 AttachmentFormat string_to_attachment_format(std::string str_format);
@@ -9,11 +9,17 @@
 #ifndef LIBAUTOLAB_CLIENT_H_
 #define LIBAUTOLAB_CLIENT_H_
 
+#include <ctime>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "autolab.h"
 #include "raw_client.h"
+#include "views.h"
 
 namespace Autolab {
 
@@ -21,16 +27,62 @@ class Client {
 private:
   RawClient raw_client;
 
+  // packagers of the requests queued in the current batch of each thread
+  std::mutex packagers_lock;
+  std::map<std::thread::id, std::vector<std::function<void()>>> pending_packagers;
+  void on_response(std::function<void()> packager);
+
 public:
   /* setup-related */
   Client(std::string domain, std::string client_id, std::string client_secret,
          std::string redirect_uri, void (*new_token_callback)(std::string, std::string));
+  // see RawClient's constructors
+  Client(std::string domain, std::string client_id, std::string client_secret,
+         std::string redirect_uri,
+         void (*new_token_callback)(std::string, std::string, std::time_t));
   void set_tokens(std::string access_token, std::string refresh_token);
+  // see RawClient::set_token_loader
+  void set_token_loader(bool (*loader)(std::string &at, std::string &rt,
+    std::time_t &expires_at));
+  // see RawClient::tokens_expire_soon and RawClient::refresh_expiring_tokens
+  bool tokens_expire_soon();
+  void refresh_expiring_tokens();
+  // see RawClient::set_token_storage_lock
+  void set_token_storage_lock(void (*lock)(), void (*unlock)());
+
+  // see RawClient::get_connection_stats and RawClient::export_connection_cache
+  RawClient::connection_stats get_connection_stats();
+  std::string export_connection_cache();
+  void import_connection_cache(const std::string &cache);
+  // see RawClient::discard_inherited_connections
+  void discard_inherited_connections();
+  // see RawClient::set_spill_threshold
+  void set_spill_threshold(size_t bytes);
+  // see RawClient::set_ca_file
+  void set_ca_file(const std::string &path);
+
+  /* response cache */
+  // Reads are answered from responses cached in dir when they are recent
+  // enough, see RawClient::enable_response_cache. Responses served while
+  // stale should be revalidated later, e.g. once the results are shown.
+  void enable_response_cache(const std::string &dir);
+  void set_cache_policy(RawClient::CachedResource resource, RawClient::CachePolicy policy);
+  void set_cache_bypass(bool bypass);
+  bool has_stale_responses();
+  void revalidate_stale_responses();
 
   /* oauth-related */
   void device_flow_init(std::string &user_code, std::string &verification_uri);
   int device_flow_authorize(size_t timeout);
 
+  /* batching */
+  // Resource-related calls made between begin_batch and end_batch are queued,
+  // then performed concurrently by end_batch, which fills in their results.
+  // The result arguments must stay valid until end_batch returns.
+  // submit_assessment is never batched and always runs right away.
+  void begin_batch();
+  void end_batch();
+
   /* resource-related */
   void get_user_info(User &user);
   void get_courses(std::vector<Course> &courses);
@@ -38,9 +90,28 @@ public:
   void get_assessment_details(DetailedAssessment &dasmt, const std::string &course_name, const std::string &asmt_name);
   void get_problems(std::vector<Problem> &probs, const std::string &course_name, const std::string &asmt_name);
   void get_submissions(std::vector<Submission> &subs, const std::string &course_name, const std::string &asmt_name);
+  // appends one row per submission to scores
+  void get_submissions(ScoreMatrix &scores, const std::string &course_name, const std::string &asmt_name);
   void get_feedback(std::string &feedback, const std::string &course_name, const std::string &asmt_name, int sub_version, const std::string &problem_name);
 
   void get_enrollments(std::vector<Enrollment> &enrollments, const std::string &course_name);
+
+  /* views */
+  // Same as above, but the results refer to the response instead of copying
+  // every field out of it. See views.h.
+  void get_courses(ViewList<CourseView> &courses);
+  void get_assessments(ViewList<AssessmentView> &asmts, const std::string &course_name);
+  void get_problems(ViewList<ProblemView> &probs, const std::string &course_name, const std::string &asmt_name);
+
+  /* streaming */
+  // Calls visitor with each element as soon as it has been received and
+  // decoded, instead of collecting all of them first. While batching, the
+  // visitor runs during end_batch. An exception thrown by the visitor aborts
+  // the transfer and is rethrown from here (or from end_batch).
+  void for_each_submission(const std::string &course_name, const std::string &asmt_name,
+    std::function<void(Submission &)> visitor);
+  void for_each_enrollment(const std::string &course_name,
+    std::function<void(Enrollment &)> visitor);
   void crud_enrollment(Enrollment &result, const std::string &course_name, std::string email, EnrollmentOption &input, CrudAction action);
 
   /* action-related */
@@ -5,14 +5,28 @@
  * users of the library to view the returned json themselves. This client should
  * be used when the user wishes to skip the response verification and packaging
  * step of the easy client.
+ *
+ * A RawClient may be used by several threads at once. Batches are per thread:
+ * requests queued by a thread are performed by its own perform_batch. The
+ * tokens are shared: when several requests are rejected for an expired token,
+ * it is refreshed once, and all of them are retried with the new one.
  */
 
 #ifndef LIBAUTOLAB_RAW_CLIENT_H_
 #define LIBAUTOLAB_RAW_CLIENT_H_
 
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <curl/curl.h>
@@ -22,28 +36,152 @@
 
 namespace Autolab {
 
+class json_array_splitter;
+class response_cache;
+struct cached_response;
+
 class RawClient {
 public:
   RawClient(const std::string &domain, const std::string &id, 
     const std::string &st, const std::string &ru, 
     void (*tk_cb)(std::string, std::string));
+  // tk_cb is also given the time the new access token expires at, 0 if the
+  // server didn't say
+  RawClient(const std::string &domain, const std::string &id,
+    const std::string &st, const std::string &ru,
+    void (*tk_cb)(std::string, std::string, std::time_t));
+  ~RawClient();
+
+  // owns curl handles, so copying is not allowed
+  RawClient(const RawClient &) = delete;
+  RawClient &operator=(const RawClient &) = delete;
 
   // setters and getters
-  void set_tokens(std::string at, std::string rt);
-  const std::string get_access_token() { return access_token; }
-  const std::string get_refresh_token() { return refresh_token; }
+  // expires_at is when the access token expires, 0 if unknown
+  void set_tokens(std::string at, std::string rt, std::time_t expires_at = 0);
+  // Instead of setting the tokens up front, has loader fetch them (e.g. from
+  // encrypted storage) when the first request is made, so that work answered
+  // from the caches doesn't pay for it. Setting the loader again makes the
+  // next request load the tokens again.
+  void set_token_loader(bool (*loader)(std::string &at, std::string &rt,
+    std::time_t &expires_at));
+  // When the tokens are stored where other processes use them too: lock and
+  // unlock are called around each token refresh, and should keep the other
+  // processes from refreshing at the same time. While locked, the tokens are
+  // loaded again with the token loader, and if another process has refreshed
+  // them meanwhile, its tokens are used instead of refreshing again.
+  void set_token_storage_lock(void (*lock)(), void (*unlock)());
+  const std::string get_access_token();
+  const std::string get_refresh_token();
   void set_new_tokens_callback(void (*cb)(std::string, std::string)) {
     new_tokens_callback = cb;
   }
 
+  /* token expiry */
+  // When the expiry of the access token is known, a request that would be
+  // sent with an expired token refreshes it first, instead of being rejected
+  // and retried. Tokens can also be refreshed ahead of time, while nothing
+  // waits for it:
+  // whether the access token expires within the next few minutes. False if
+  // its expiry is unknown, or the tokens haven't been loaded yet.
+  bool tokens_expire_soon();
+  // refreshes the tokens if they expire soon
+  void refresh_expiring_tokens();
+
+  // counts how many transfers were able to reuse an existing connection
+  // instead of performing a new TCP and TLS handshake, and how many bytes the
+  // response bodies took on the wire (compressed) vs. after decoding.
+  struct connection_stats {
+    long transfers;
+    long new_connections;
+    long reused_connections;
+    long long bytes_received;
+    long long bytes_decoded;
+  };
+  connection_stats get_connection_stats();
+
+  /* connection cache */
+  // Exports the resolved server address and the TLS session tickets, so that
+  // a later process can import them to skip the DNS lookup and resume the TLS
+  // session instead of performing a full handshake. The format is opaque to
+  // the application, expired entries are dropped on import.
+  std::string export_connection_cache();
+  void import_connection_cache(const std::string &cache);
+  // To be called in the child after fork(). The open connections are shared
+  // with the parent, and two processes writing to one TLS stream corrupt it.
+  // This drops them without closing them, so later transfers make new
+  // connections. The resolved address and the TLS sessions are kept.
+  void discard_inherited_connections();
+  // Trusts the certificates in the PEM file at path instead of the system's,
+  // e.g. for a server with a certificate from a private CA. Must be set
+  // before the first request.
+  void set_ca_file(const std::string &path) { ca_file = path; }
+
+  /* pooled response documents */
+  // Returns an empty document to receive a response. Its values, and the body
+  // they are parsed from in place, are allocated from a buffer owned by this
+  // client, which is reused for the next document once this one is released.
+  // After the buffer has grown to fit the responses seen, parsing no longer
+  // grows the heap.
+  std::shared_ptr<rapidjson::Document> new_response();
+
+  /* large responses */
+  // Response bodies larger than this many bytes are written to an unlinked
+  // temporary file while they are received, instead of being kept in memory,
+  // and parsed from a read-only mapping of that file. 0 keeps every body in
+  // memory. Streamed array elements are never buffered either way.
+  void set_spill_threshold(size_t bytes) { spill_threshold = bytes; }
+  size_t get_spill_threshold() { return spill_threshold; }
+
+  /* response cache */
+  // resources that each have their own cache policy
+  enum CachedResource {CacheUserInfo, CacheCourses, CacheAssessments,
+    CacheAssessmentDetails, CacheProblems, CacheSubmissions, CacheFeedback,
+    CacheEnrollments, NumCachedResources};
+  // A cached response younger than ttl seconds is served without asking the
+  // server. For max_stale seconds after that, it is still served right away,
+  // but remembered for revalidation. Older responses are fetched again.
+  struct CachePolicy {
+    std::time_t ttl;
+    std::time_t max_stale;
+  };
+  // Stores successful responses to reads in dir, which must exist, and serves
+  // later reads from there. Submitting an assessment or changing an enrollment
+  // invalidates the cached responses it affects.
+  void enable_response_cache(const std::string &dir);
+  void set_cache_policy(CachedResource resource, CachePolicy policy) {
+    cache_policies[resource] = policy;
+  }
+  // while set, reads always go to the server, but their responses are still
+  // stored
+  void set_cache_bypass(bool bypass) { cache_bypass = bypass; }
+  // whether stale responses were served since the last revalidation
+  bool has_stale_responses();
+  // fetches all responses that were served stale again, concurrently, and
+  // stores them in the cache.
+  void revalidate_stale_responses();
+
   /* oauth-related */
   void device_flow_init(std::string &user_code, std::string &verification_uri);
   int device_flow_authorize(size_t timeout);
 
+  /* batching */
+  // While batching, requests are queued instead of performed right away, and
+  // their result documents are only filled in by perform_batch, which performs
+  // all queued requests concurrently. The result documents passed in while
+  // batching must stay valid until then. File uploads are never batched.
+  void begin_batch();
+  void perform_batch();
+  bool is_batching();
+
+  // how a response was classified when its body was parsed
+  enum ResponseStatus {ResponseOk, ResponseError, ResponseAuthFailed};
+
   // keeps track of state and config for the current request.
   struct request_state {
     bool file_upload;
     std::string upload_filename;
+    struct curl_httppost *formpost;
 
     bool is_download;
     std::string suggested_filename;
@@ -51,22 +189,69 @@ public:
     std::string string_output;
     std::ofstream file_output;
     long response_code;
+    // size of the decoded response body
+    size_t body_size;
+    // once the body outgrows spill_threshold, it is moved from string_output
+    // to this temporary file, which is removed again when it is closed.
+    size_t spill_threshold;
+    int spill_fd;
+    // set when the elements of an array response are streamed out
+    std::shared_ptr<json_array_splitter> splitter;
+    // error raised while handling streamed elements, rethrown after the
+    // transfer has been aborted
+    std::exception_ptr stream_error;
+    // the document the body is parsed into, and what it turned out to be
+    rapidjson::Document *response;
+    ResponseStatus status;
+    // set if the response is to be stored in the response cache. Streamed
+    // bodies are kept in kept_body for that, unless they get too large.
+    std::string cache_key;
+    std::string kept_body;
+    // validators sent by the server, stored in the cache with the body
+    std::string etag;
+    std::string last_modified;
+    // For conditional requests, the validators of the cached response, and
+    // its body, which is used instead if the server answers 304 Not Modified.
+    std::string if_none_match;
+    std::string if_modified_since;
+    std::string cached_body;
+    struct curl_slist *headers;
 
     request_state() :
-      file_upload(false), is_download(false) {}
-    request_state(std::string dir, std::string name_hint) :
-      file_upload(false), is_download(false), suggested_filename(name_hint), 
-      download_dir(dir) {}
-
-    void reset() {
-      is_download = false;
-      string_output.clear();
+      file_upload(false), formpost(nullptr), is_download(false), body_size(0),
+      spill_threshold(0), spill_fd(-1), response(nullptr), status(ResponseOk),
+      headers(nullptr) {}
+    request_state(rapidjson::Document &resp, std::string dir, std::string name_hint) :
+      file_upload(false), formpost(nullptr), is_download(false),
+      suggested_filename(name_hint), download_dir(dir), body_size(0),
+      spill_threshold(0), spill_fd(-1), response(&resp), status(ResponseOk),
+      headers(nullptr) {}
+    ~request_state() {
+      close_spill_file();
+      free_headers();
     }
 
+    void reset();
+    void close_spill_file();
+
     void close_file_output() {
       if (file_output.is_open()) file_output.close();
     }
 
+    void free_form() {
+      if (formpost) curl_formfree(formpost);
+      formpost = nullptr;
+    }
+
+    void free_headers() {
+      if (headers) curl_slist_free_all(headers);
+      headers = nullptr;
+    }
+
+    bool is_conditional() {
+      return if_none_match.length() > 0 || if_modified_since.length() > 0;
+    }
+
     bool consider_download() {
       return download_dir.length() > 0;
     }
@@ -74,7 +259,15 @@ public:
 
   typedef std::vector<std::pair<std::string, std::string>> Params;
 
+  // receives the json text of one element of an array response, as soon as it
+  // has been received. The text is only valid during the call.
+  typedef std::function<void(const char *, size_t)> ElementCallback;
+
   /* REST interface methods */
+  // The variants taking an ElementCallback stream the elements of an array
+  // response to the callback while it is being received, and leave result as
+  // an empty array. Any other response, such as an error, is parsed into
+  // result as usual.
   void get_user_info(rapidjson::Document &result);
   void get_courses(rapidjson::Document &result);
   void get_assessments(rapidjson::Document &result, const std::string &course_name);
@@ -84,20 +277,97 @@ public:
   void download_writeup(rapidjson::Document &result, std::string download_dir, const std::string &course_name, const std::string &asmt_name);
   void submit_assessment(rapidjson::Document &result, const std::string &course_name, const std::string &asmt_name, std::string filename);
   void get_submissions(rapidjson::Document &result, const std::string &course_name, const std::string &asmt_name);
+  void get_submissions(rapidjson::Document &result, ElementCallback element_cb, const std::string &course_name, const std::string &asmt_name);
   void get_feedback(rapidjson::Document &result, const std::string &course_name, const std::string &asmt_name, int sub_version, const std::string &problem_name);
   void get_enrollments(rapidjson::Document &result, const std::string &course_name);
+  void get_enrollments(rapidjson::Document &result, ElementCallback element_cb, const std::string &course_name);
   void crud_enrollment(rapidjson::Document &result, const std::string &course_name, std::string email, Params &in_params, CrudAction action);
 
 private:
   // domain of the autolab service
   std::string base_uri;
+  // certificates trusted instead of the system's, if set
+  std::string ca_file;
 
   // initializes curl interface. Must be called before anything else.
   static int curl_ready;
   static int init_curl();
+  // sets up curl and the share object on first use
+  std::atomic<bool> transfers_ready;
+  std::mutex transfers_lock;
+  void init_transfers();
+
+  // pool of idle curl easy handles, so handles don't have to be set up again
+  // for every request.
+  std::mutex handles_lock;
+  std::vector<CURL *> idle_handles;
+  CURL *acquire_handle();
+  void release_handle(CURL *curl);
+  void configure_handle(CURL *curl);
+
+  // multi handles drive the concurrent transfers of batches, one per batch
+  // being performed. Also guarded by handles_lock.
+  std::vector<CURLM *> idle_multi_handles;
+  CURLM *acquire_multi_handle();
+  void release_multi_handle(CURLM *multi);
+
+  // DNS cache, TLS sessions and connections shared by all handles, so every
+  // transfer benefits from the first handshake with the server.
+  CURLSH *share_handle;
+  std::mutex share_locks[CURL_LOCK_DATA_LAST];
+  static void lock_share(CURL *curl, curl_lock_data data,
+    curl_lock_access access, void *client);
+  static void unlock_share(CURL *curl, curl_lock_data data, void *client);
+  void init_share();
+
+  // resolved server address in CURLOPT_RESOLVE format, and when it expires.
+  // resolve_list is set only while an imported address is in use. Lists that
+  // are no longer used may still be set on running transfers, so they are
+  // only freed with the client.
+  std::mutex resolve_lock;
+  std::string resolved_address;
+  std::time_t resolved_address_expiry;
+  struct curl_slist *resolve_list;
+  std::vector<struct curl_slist *> retired_resolve_lists;
+  void remember_resolved_address(CURL *curl);
+  void forget_resolved_address();
+
+  // TLS session entries of an imported connection cache, waiting for the share
+  // object to be set up. Guarded by transfers_lock.
+  std::vector<std::string> pending_tls_sessions;
+  void import_tls_session(const std::string &line);
+
+  std::atomic<long> num_transfers;
+  std::atomic<long> num_new_connections;
+  std::atomic<long> num_reused_connections;
+  std::atomic<long long> num_bytes_received;
+  std::atomic<long long> num_bytes_decoded;
+
+  size_t spill_threshold;
+
+  // a document together with the buffer its values are allocated from.
+  struct response_arena {
+    std::vector<char> buffer;
+    std::unique_ptr<rapidjson::MemoryPoolAllocator<>> allocator;
+    std::unique_ptr<rapidjson::Document> document;
+
+    void recycle();
+  };
+  // arenas not in use by any document. Shared with the documents handed out,
+  // so they can return their arena after this client is gone.
+  struct arena_pool {
+    std::mutex lock;
+    std::vector<std::unique_ptr<response_arena>> idle;
+  };
+  std::shared_ptr<arena_pool> arenas;
+
+  std::unique_ptr<response_cache> cache;
+  CachePolicy cache_policies[NumCachedResources];
+  std::atomic<bool> cache_bypass;
 
   // tokens-related
   void (*new_tokens_callback)(std::string, std::string);
+  void (*new_expiring_tokens_callback)(std::string, std::string, std::time_t);
 
   enum HttpMethod {GET, POST, PUT, DELETE};
   HttpMethod crud_to_http(CrudAction action);
@@ -132,16 +402,85 @@ private:
   std::string client_id;
   std::string client_secret;
   std::string redirect_uri;
+  // The tokens are shared by every thread: tokens_lock guards them, and is
+  // only held to read or replace them. refresh_lock is held for the whole of
+  // a refresh, so that only one runs at a time.
   std::string access_token;
   std::string refresh_token;
+  std::time_t access_token_expires_at; // 0 if unknown
+  bool (*token_loader)(std::string &at, std::string &rt, std::time_t &expires_at);
+  void (*lock_token_storage)();
+  void (*unlock_token_storage)();
+  std::atomic<bool> tokens_loaded;
+  std::mutex tokens_lock;
+  std::mutex refresh_lock;
+  // the refresh token the server last rejected, so it isn't tried again
+  std::string rejected_refresh_token;
+  void load_tokens_if_needed();
+  // Called when the server rejected rejected_access_token. Refreshes the
+  // tokens, unless another request already did while this one waited for
+  // refresh_lock. Returns whether there is a new access token to retry with.
+  bool refresh_rejected_token(const std::string &rejected_access_token);
+  // refreshes before sending requests with a token that has expired
+  void refresh_if_expired();
   std::string device_flow_device_code;
   std::string device_flow_user_code;
 
+  // a request queued while batching.
+  struct batch_request {
+    path_segments path;
+    param_list params;
+    HttpMethod method;
+    bool refresh;
+    request_state rstate;
+    CURL *curl;
+    CURLcode result;
+    // answered from the response cache, with the body in rstate.kept_body
+    bool from_cache;
+
+    batch_request(rapidjson::Document &resp, path_segments &pa, param_list &pr,
+      HttpMethod m, bool rf, const std::string &dir, const std::string &name_hint) :
+      path(pa), params(pr), method(m), refresh(rf),
+      rstate(resp, dir, name_hint), curl(nullptr), result(CURLE_OK),
+      from_cache(false) {}
+  };
+  // the requests queued by each thread that is batching
+  typedef std::vector<std::unique_ptr<batch_request>> batch_request_queue;
+  std::mutex batches_lock;
+  std::map<std::thread::id, batch_request_queue> batches;
+  // nullptr if the calling thread isn't batching
+  batch_request_queue *current_batch();
+
+  void setup_request(CURL *curl, request_state *rstate, path_segments &path, param_list &params, HttpMethod method);
+  long finish_request(CURL *curl, request_state *rstate);
+  void raw_request_concurrently(std::vector<batch_request *> &requests);
+
   // perform HTTP request and return result, default method is GET.
   long raw_request(request_state *rstate, path_segments &path, param_list &params, HttpMethod method);
   long raw_request_optional_refresh(request_state *rstate, path_segments &path, param_list &params, HttpMethod method, bool refresh);
   long make_request(rapidjson::Document &response, path_segments &path, param_list &params, HttpMethod method, bool refresh, 
-    const std::string &download_dir, const std::string &suggested_filename, const std::string &upload_filename);
+    const std::string &download_dir, const std::string &suggested_filename, const std::string &upload_filename,
+    const ElementCallback &element_cb, const std::string &cache_key, cached_response *cached);
+
+  // reads that are answered from the response cache when possible
+  struct stale_request {
+    std::string key;
+    path_segments path;
+    param_list params;
+  };
+  std::mutex stale_lock;
+  std::vector<stale_request> stale_requests;
+  std::string cache_key(const path_segments &path, const param_list &params);
+  long make_cached_request(rapidjson::Document &response, CachedResource resource,
+    path_segments &path, param_list &params, const ElementCallback &element_cb);
+  void serve_cached(request_state *rstate, std::string &body);
+  void serve_cached_or_invalidate(request_state *rstate, std::string &body);
+  void serve_not_modified(request_state *rstate);
+  void store_response(request_state *rstate);
+  void invalidate_cached(const path_segments &path);
+  void stream_elements(request_state *rstate, const ElementCallback &element_cb);
+  void parse_body(request_state *rstate);
+  void parse_spilled_body(request_state *rstate);
 
   void clear_device_flow_strings();
 
@@ -149,13 +488,15 @@ private:
   bool get_token_from_authorization_code(std::string authorization_code);
   bool perform_token_refresh();
 
-  bool document_has_error(request_state *rstate, const std::string &error_msg);
   void init_regular_path(path_segments &path);
+  void init_submissions_path(path_segments &path, const std::string &course_name, const std::string &asmt_name);
+  void init_enrollments_path(path_segments &path, const std::string &course_name);
   void init_regular_params(param_list &params);
   void init_oauth_token_path(path_segments &path);
   void init_device_flow_init_path(path_segments &path);
   void init_device_flow_authorize_path(path_segments &path);
   void update_access_token_in_params(param_list &params);
+  std::string access_token_in_params(const param_list &params);
 };
 
 }
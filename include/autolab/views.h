@@ -0,0 +1,147 @@
+/*
+ * Read-only views of responses.
+ *
+ * A ViewList owns the parsed response. Its elements refer to the strings inside
+ * it instead of copying them into std::strings, so listing resources needs
+ * almost no allocations per field. Everything returned by a view stays valid
+ * as long as the list it came from (or a copy of it) exists. Timestamps are
+ * only parsed when first asked for.
+ *
+ * Required fields are checked when the list is filled in, so the accessors
+ * never throw. Optional fields have the same fallbacks as in the plain structs.
+ */
+
+#ifndef LIBAUTOLAB_VIEWS_H_
+#define LIBAUTOLAB_VIEWS_H_
+
+#include <cstddef>
+#include <ctime>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "autolab.h"
+
+namespace Autolab {
+
+// a string that isn't owned by the view, similar to C++17's std::string_view.
+class StringView {
+public:
+  StringView() : ptr(""), len(0) {}
+  StringView(const char *p, size_t l) : ptr(p), len(l) {}
+
+  const char *data() const { return ptr; }
+  size_t length() const { return len; }
+  bool empty() const { return len == 0; }
+  std::string str() const { return std::string(ptr, len); }
+
+  int compare(const StringView &other) const;
+  bool operator==(const StringView &other) const { return compare(other) == 0; }
+  bool operator!=(const StringView &other) const { return compare(other) != 0; }
+  bool operator<(const StringView &other) const { return compare(other) < 0; }
+
+private:
+  const char *ptr;
+  size_t len;
+};
+
+std::ostream &operator<<(std::ostream &out, const StringView &view);
+
+class CourseView {
+public:
+  explicit CourseView(const rapidjson::Value &v) : json(&v) {}
+  // throws InvalidResponseException if a required field is missing
+  static void validate(const rapidjson::Value &v);
+
+  StringView name() const;
+  StringView display_name() const;
+  StringView semester() const;
+  int late_slack() const;
+  int grace_days() const;
+  AuthorizationLevel auth_level() const;
+
+private:
+  const rapidjson::Value *json;
+};
+
+class AssessmentView {
+public:
+  explicit AssessmentView(const rapidjson::Value &v) : json(&v), parsed_times(0) {}
+  static void validate(const rapidjson::Value &v);
+
+  StringView name() const;
+  StringView display_name() const;
+  StringView category_name() const;
+  std::time_t start_at() const;
+  std::time_t due_at() const;
+  std::time_t end_at() const;
+  std::time_t grading_deadline() const;
+
+private:
+  enum time_field {start_at_field, due_at_field, end_at_field,
+                   grading_deadline_field, num_time_fields};
+
+  const rapidjson::Value *json;
+  // timestamps parsed so far, one bit per time_field
+  mutable unsigned parsed_times;
+  mutable std::time_t times[num_time_fields];
+
+  std::time_t get_time(time_field field, const char *key) const;
+};
+
+class ProblemView {
+public:
+  explicit ProblemView(const rapidjson::Value &v) : json(&v) {}
+  static void validate(const rapidjson::Value &v);
+
+  StringView name() const;
+  StringView description() const;
+  double max_score() const;
+  bool optional() const;
+
+private:
+  const rapidjson::Value *json;
+};
+
+// compare by name, then by category (as Utility::compare_assessments_by_name)
+bool compare_assessment_views_by_name(const AssessmentView &a, const AssessmentView &b);
+
+template <typename View>
+class ViewList {
+public:
+  typedef typename std::vector<View>::iterator iterator;
+  typedef typename std::vector<View>::const_iterator const_iterator;
+
+  size_t size() const { return views.size(); }
+  bool empty() const { return views.empty(); }
+  View &operator[](size_t i) { return views[i]; }
+  const View &operator[](size_t i) const { return views[i]; }
+  iterator begin() { return views.begin(); }
+  iterator end() { return views.end(); }
+  const_iterator begin() const { return views.begin(); }
+  const_iterator end() const { return views.end(); }
+
+  // take ownership of the response and add a view of each of its elements
+  void assign(std::shared_ptr<rapidjson::Document> doc) {
+    response = doc;
+    views.clear();
+    views.reserve(response->Size());
+    for (rapidjson::Value::ValueIterator it = response->Begin();
+         it != response->End(); ++it) {
+      View::validate(*it);
+      views.push_back(View(*it));
+    }
+  }
+
+private:
+  std::shared_ptr<rapidjson::Document> response;
+  std::vector<View> views;
+};
+
+}
+
+#endif /* LIBAUTOLAB_VIEWS_H_ */
@@ -1,15 +1,19 @@
 #include "autolab/client.h"
 
-#include <cmath>
-
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <rapidjson/document.h>
 
 #include "autolab/raw_client.h"
+#include "json_fields.h"
 #include "json_helpers.h"
 #include "logger.h"
+#include "element_packagers.h"
 
 namespace Autolab {
 
@@ -18,10 +22,79 @@ Client::Client(std::string domain, std::string client_id,
                void (*new_token_callback)(std::string, std::string))
   : raw_client(domain, client_id, client_secret, redirect_uri, new_token_callback) {}
 
+Client::Client(std::string domain, std::string client_id,
+               std::string client_secret, std::string redirect_uri,
+               void (*new_token_callback)(std::string, std::string, std::time_t))
+  : raw_client(domain, client_id, client_secret, redirect_uri, new_token_callback) {}
+
 void Client::set_tokens(std::string access_token, std::string refresh_token) {
   raw_client.set_tokens(access_token, refresh_token);
 }
 
+void Client::set_token_loader(bool (*loader)(std::string &at, std::string &rt,
+  std::time_t &expires_at))
+{
+  raw_client.set_token_loader(loader);
+}
+
+bool Client::tokens_expire_soon() {
+  return raw_client.tokens_expire_soon();
+}
+
+void Client::refresh_expiring_tokens() {
+  raw_client.refresh_expiring_tokens();
+}
+
+void Client::set_token_storage_lock(void (*lock)(), void (*unlock)()) {
+  raw_client.set_token_storage_lock(lock, unlock);
+}
+
+RawClient::connection_stats Client::get_connection_stats() {
+  return raw_client.get_connection_stats();
+}
+
+std::string Client::export_connection_cache() {
+  return raw_client.export_connection_cache();
+}
+
+void Client::import_connection_cache(const std::string &cache) {
+  raw_client.import_connection_cache(cache);
+}
+
+void Client::discard_inherited_connections() {
+  raw_client.discard_inherited_connections();
+}
+
+void Client::set_spill_threshold(size_t bytes) {
+  raw_client.set_spill_threshold(bytes);
+}
+
+void Client::set_ca_file(const std::string &path) {
+  raw_client.set_ca_file(path);
+}
+
+/* response cache */
+void Client::enable_response_cache(const std::string &dir) {
+  raw_client.enable_response_cache(dir);
+}
+
+void Client::set_cache_policy(RawClient::CachedResource resource,
+    RawClient::CachePolicy policy) {
+  raw_client.set_cache_policy(resource, policy);
+}
+
+void Client::set_cache_bypass(bool bypass) {
+  raw_client.set_cache_bypass(bypass);
+}
+
+bool Client::has_stale_responses() {
+  return raw_client.has_stale_responses();
+}
+
+void Client::revalidate_stale_responses() {
+  raw_client.revalidate_stale_responses();
+}
+
 /* oauth-related */
 void Client::device_flow_init(std::string &user_code, std::string &verification_uri) {
   raw_client.device_flow_init(user_code, verification_uri);
@@ -31,6 +104,39 @@ int Client::device_flow_authorize(size_t timeout) {
   return raw_client.device_flow_authorize(timeout);
 }
 
+/* batching */
+void Client::begin_batch() {
+  raw_client.begin_batch();
+}
+
+void Client::end_batch() {
+  std::vector<std::function<void()>> packagers;
+  {
+    std::lock_guard<std::mutex> guard(packagers_lock);
+    auto it = pending_packagers.find(std::this_thread::get_id());
+    if (it != pending_packagers.end()) {
+      packagers.swap(it->second);
+      pending_packagers.erase(it);
+    }
+  }
+
+  raw_client.perform_batch();
+  for (auto &packager : packagers) {
+    packager();
+  }
+}
+
+// run the packager once its response document is filled in: right away, or at
+// end_batch while batching.
+void Client::on_response(std::function<void()> packager) {
+  if (raw_client.is_batching()) {
+    std::lock_guard<std::mutex> guard(packagers_lock);
+    pending_packagers[std::this_thread::get_id()].push_back(packager);
+    return;
+  }
+  packager();
+}
+
 /* custom utility */
 void download_response_to_attachment_format(Attachment &attachment,
       rapidjson::Value &response) {
@@ -58,177 +164,271 @@ void check_for_error_response(rapidjson::Value &response) {
 }
 
 /* packagers */
-void user_from_json(User &user, rapidjson::Value &user_json) {
-  user.first_name = get_string_force(user_json, "first_name");
-  user.last_name  = get_string_force(user_json, "last_name");
-  user.email      = get_string_force(user_json, "email");
-  user.school     = get_string(user_json, "school");
-  user.major      = get_string(user_json, "major");
-  user.year       = get_string(user_json, "year");
-}
-
-void assessment_from_json(Assessment &asmt, rapidjson::Value &asmt_json) {
-  asmt.name          = get_string_force(asmt_json, "name");
-  asmt.display_name  = get_string(asmt_json, "display_name");
-  asmt.category_name = get_string(asmt_json, "category_name");
-
-  asmt.start_at = Utility::string_to_time(get_string_force(asmt_json, "start_at"));
-  asmt.due_at   = Utility::string_to_time(get_string_force(asmt_json, "due_at"));
-  asmt.end_at   = Utility::string_to_time(get_string_force(asmt_json, "end_at"));
-  asmt.grading_deadline = Utility::string_to_time(get_string(asmt_json, "grading_deadline"));
-}
-
-void enrollment_from_json(Enrollment &enrollment, rapidjson::Value &enrollment_json) {
-  enrollment.lecture = get_string(enrollment_json, "lecture");
-  enrollment.section = get_string(enrollment_json, "section");
-  enrollment.grade_policy = get_string(enrollment_json, "grade_policy");
-  enrollment.nickname = get_string(enrollment_json, "nickname");
-  enrollment.dropped = get_bool(enrollment_json, "dropped", false);
-  enrollment.auth_level = Utility::string_to_authorization_level(
-      get_string_force(enrollment_json, "auth_level"));
-  user_from_json(enrollment.user, enrollment_json);
+const json_field<User> user_fields[] = {
+  {"first_name", field_required, json_string<User, &User::first_name>},
+  {"last_name",  field_required, json_string<User, &User::last_name>},
+  {"email",      field_required, json_string<User, &User::email>},
+  {"school",     field_optional, json_string<User, &User::school>},
+  {"major",      field_optional, json_string<User, &User::major>},
+  {"year",       field_optional, json_string<User, &User::year>}
+};
+
+const json_field<Course> course_fields[] = {
+  {"name",         field_required, json_string<Course, &Course::name>},
+  {"display_name", field_optional, json_string<Course, &Course::display_name>},
+  {"semester",     field_optional, json_string<Course, &Course::semester>},
+  {"late_slack",   field_optional, json_int<Course, &Course::late_slack, 0>},
+  {"grace_days",   field_optional, json_int<Course, &Course::grace_days, 0>},
+  {"auth_level",   field_required, json_auth_level<Course, &Course::auth_level>}
+};
+
+const json_field<Assessment> assessment_fields[] = {
+  {"name",          field_required, json_string<Assessment, &Assessment::name>},
+  {"display_name",  field_optional, json_string<Assessment, &Assessment::display_name>},
+  {"category_name", field_optional, json_string<Assessment, &Assessment::category_name>},
+  {"start_at",      field_required, json_time<Assessment, &Assessment::start_at>},
+  {"due_at",        field_required, json_time<Assessment, &Assessment::due_at>},
+  {"end_at",        field_required, json_time<Assessment, &Assessment::end_at>},
+  {"grading_deadline", field_optional, json_time<Assessment, &Assessment::grading_deadline>}
+};
+
+// the assessment fields come first, so errors are reported in the same order
+template <const char *(*Store)(Assessment &, json_value *)>
+const char *dasmt_asmt(DetailedAssessment &result, json_value *value) {
+  return json_nested<DetailedAssessment, Assessment, &DetailedAssessment::asmt, Store>(result, value);
 }
+const json_field<DetailedAssessment> detailed_assessment_fields[] = {
+  {"name",          field_required, dasmt_asmt<json_string<Assessment, &Assessment::name>>},
+  {"display_name",  field_optional, dasmt_asmt<json_string<Assessment, &Assessment::display_name>>},
+  {"category_name", field_optional, dasmt_asmt<json_string<Assessment, &Assessment::category_name>>},
+  {"start_at",      field_required, dasmt_asmt<json_time<Assessment, &Assessment::start_at>>},
+  {"due_at",        field_required, dasmt_asmt<json_time<Assessment, &Assessment::due_at>>},
+  {"end_at",        field_required, dasmt_asmt<json_time<Assessment, &Assessment::end_at>>},
+  {"grading_deadline", field_optional, dasmt_asmt<json_time<Assessment, &Assessment::grading_deadline>>},
+  {"description",     field_optional, json_string<DetailedAssessment, &DetailedAssessment::description>},
+  {"max_grace_days",  field_optional, json_int<DetailedAssessment, &DetailedAssessment::max_grace_days, -1>},
+  {"max_submissions", field_optional, json_int<DetailedAssessment, &DetailedAssessment::max_submissions, -1>},
+  {"group_size",      field_optional, json_int<DetailedAssessment, &DetailedAssessment::group_size, 1>},
+  {"disable_handins", field_optional, json_bool<DetailedAssessment, &DetailedAssessment::disable_handins, false>},
+  {"has_scoreboard",  field_optional, json_bool<DetailedAssessment, &DetailedAssessment::has_scoreboard, false>},
+  {"has_autograder",  field_optional, json_bool<DetailedAssessment, &DetailedAssessment::has_autograder, false>},
+  {"handout_format",  field_required, json_attachment_format<DetailedAssessment, &DetailedAssessment::handout_format>},
+  {"writeup_format",  field_required, json_attachment_format<DetailedAssessment, &DetailedAssessment::writeup_format>}
+};
+
+const json_field<Problem> problem_fields[] = {
+  {"name",        field_required, json_string<Problem, &Problem::name>},
+  {"description", field_optional, json_string<Problem, &Problem::description>},
+  {"max_score",   field_optional, json_double<Problem, &Problem::max_score>},
+  {"optional",    field_optional, json_bool<Problem, &Problem::optional, false>}
+};
+
+// the packagers of the streamed types are in element_packagers.cpp
 
 /* resource-related */
 void Client::get_user_info(User &user) {
-  rapidjson::Document user_info_doc;
-  raw_client.get_user_info(user_info_doc);
-  check_for_error_response(user_info_doc);
+  std::shared_ptr<rapidjson::Document> user_info_doc_ptr = raw_client.new_response();
+  raw_client.get_user_info(*user_info_doc_ptr);
 
-  require_is_object(user_info_doc);
+  on_response([&user, user_info_doc_ptr]() {
+    rapidjson::Document &user_info_doc = *user_info_doc_ptr;
+    check_for_error_response(user_info_doc);
 
-  user_from_json(user, user_info_doc);
+    require_is_object(user_info_doc);
+
+    decode_object(user, user_info_doc, user_fields);
+  });
 }
 
 void Client::get_courses(std::vector<Course> &courses) {
-  rapidjson::Document courses_doc;
-  raw_client.get_courses(courses_doc);
-  check_for_error_response(courses_doc);
-
-  require_is_array(courses_doc);
-  for (auto &c_doc : courses_doc.GetArray()) {
-    Course course;
-    course.name         = get_string_force(c_doc, "name");
-    course.display_name = get_string(c_doc, "display_name");
-    course.semester     = get_string(c_doc, "semester");
-    course.late_slack   = get_int(c_doc, "late_slack", 0);
-    course.grace_days   = get_int(c_doc, "grace_days", 0);
-    course.auth_level   = Utility::string_to_authorization_level(
-        get_string_force(c_doc, "auth_level"));
-
-    courses.push_back(course);
-  }
+  std::shared_ptr<rapidjson::Document> courses_doc_ptr = raw_client.new_response();
+  raw_client.get_courses(*courses_doc_ptr);
+
+  on_response([&courses, courses_doc_ptr]() {
+    rapidjson::Document &courses_doc = *courses_doc_ptr;
+    check_for_error_response(courses_doc);
+
+    require_is_array(courses_doc);
+    for (auto &c_doc : courses_doc.GetArray()) {
+      Course course;
+      decode_object(course, c_doc, course_fields);
+
+      courses.push_back(course);
+    }
+  });
 }
 
 void Client::get_assessments(std::vector<Assessment> &asmts, const std::string &course_name) {
-  rapidjson::Document asmts_doc;
-  raw_client.get_assessments(asmts_doc, course_name);
-  check_for_error_response(asmts_doc);
+  std::shared_ptr<rapidjson::Document> asmts_doc_ptr = raw_client.new_response();
+  raw_client.get_assessments(*asmts_doc_ptr, course_name);
 
-  require_is_array(asmts_doc);
-  for (auto &a_doc : asmts_doc.GetArray()) {
-    Assessment asmt;
-    assessment_from_json(asmt, a_doc);
+  on_response([&asmts, asmts_doc_ptr]() {
+    rapidjson::Document &asmts_doc = *asmts_doc_ptr;
+    check_for_error_response(asmts_doc);
 
-    asmts.push_back(asmt);
-  }
+    require_is_array(asmts_doc);
+    for (auto &a_doc : asmts_doc.GetArray()) {
+      Assessment asmt;
+      decode_object(asmt, a_doc, assessment_fields);
+
+      asmts.push_back(asmt);
+    }
+  });
 }
 
 void Client::get_assessment_details(DetailedAssessment &dasmt,
     const std::string &course_name, const std::string &asmt_name) {
-  rapidjson::Document dasmt_doc;
-  raw_client.get_assessment_details(dasmt_doc, course_name, asmt_name);
-  check_for_error_response(dasmt_doc);
-
-  require_is_object(dasmt_doc);
-
-  assessment_from_json(dasmt.asmt, dasmt_doc);
-  
-  dasmt.description     = get_string(dasmt_doc, "description");
-  dasmt.max_grace_days  = get_int(dasmt_doc, "max_grace_days", -1);
-  dasmt.max_submissions = get_int(dasmt_doc, "max_submissions", -1);
-  dasmt.group_size      = get_int(dasmt_doc, "group_size", 1);
-  dasmt.disable_handins = get_bool(dasmt_doc, "disable_handins", false);
-  dasmt.has_scoreboard  = get_bool(dasmt_doc, "has_scoreboard", false);
-  dasmt.has_autograder  = get_bool(dasmt_doc, "has_autograder", false);
-  dasmt.handout_format  = Utility::string_to_attachment_format(
-      get_string_force(dasmt_doc, "handout_format"));
-  dasmt.writeup_format  = Utility::string_to_attachment_format(
-      get_string_force(dasmt_doc, "writeup_format"));
+  std::shared_ptr<rapidjson::Document> dasmt_doc_ptr = raw_client.new_response();
+  raw_client.get_assessment_details(*dasmt_doc_ptr, course_name, asmt_name);
+
+  on_response([&dasmt, dasmt_doc_ptr]() {
+    rapidjson::Document &dasmt_doc = *dasmt_doc_ptr;
+    check_for_error_response(dasmt_doc);
+
+    require_is_object(dasmt_doc);
+
+    decode_object(dasmt, dasmt_doc, detailed_assessment_fields);
+  });
 }
 
 void Client::get_problems(std::vector<Problem> &probs, const std::string &course_name,
     const std::string &asmt_name) {
-  rapidjson::Document probs_doc;
-  raw_client.get_problems(probs_doc, course_name, asmt_name);
-  check_for_error_response(probs_doc);
-
-  require_is_array(probs_doc);
-  for (auto &p_doc : probs_doc.GetArray()) {
-    Problem prob;
-    prob.name        = get_string_force(p_doc, "name");
-    prob.description = get_string(p_doc, "description");
-    prob.max_score   = get_double(p_doc, "max_score");
-    prob.optional    = get_bool(p_doc, "optional", false);
-
-    probs.push_back(prob);
-  }
+  std::shared_ptr<rapidjson::Document> probs_doc_ptr = raw_client.new_response();
+  raw_client.get_problems(*probs_doc_ptr, course_name, asmt_name);
+
+  on_response([&probs, probs_doc_ptr]() {
+    rapidjson::Document &probs_doc = *probs_doc_ptr;
+    check_for_error_response(probs_doc);
+
+    require_is_array(probs_doc);
+    for (auto &p_doc : probs_doc.GetArray()) {
+      Problem prob;
+      decode_object(prob, p_doc, problem_fields);
+
+      probs.push_back(prob);
+    }
+  });
 }
 
 void Client::get_submissions(std::vector<Submission> &subs, 
     const std::string &course_name, const std::string &asmt_name) {
-  rapidjson::Document subs_doc;
-  raw_client.get_submissions(subs_doc, course_name, asmt_name);
-  check_for_error_response(subs_doc);
-
-  require_is_array(subs_doc);
-  for (auto &s_doc : subs_doc.GetArray()) {
-    Submission sub;
-    sub.version    = get_int_force(s_doc, "version");
-    sub.created_at = Utility::string_to_time(get_string_force(s_doc, "created_at"));
-    sub.filename   = get_string(s_doc, "filename");
-    std::map<std::string, double> &scores = sub.scores;
-
-    rapidjson::Value &scores_doc = s_doc["scores"];
-    require_is_object(scores_doc);
-    // iterate through members of the object
-    for (auto &m : scores_doc.GetObject()) {
-      const std::string &problem_name = m.name.GetString();
-      double score;
-      if (m.value.IsDouble()) {
-        score = m.value.GetDouble();
-      } else {
-        score = std::nan(""); // unreleased
-      }
-      scores[problem_name] = score;
-    }
-
+  for_each_submission(course_name, asmt_name, [&subs](Submission &sub) {
     subs.push_back(sub);
-  }
+  });
+}
+
+void Client::get_submissions(ScoreMatrix &scores,
+    const std::string &course_name, const std::string &asmt_name) {
+  std::shared_ptr<rapidjson::Document> subs_doc_ptr = raw_client.new_response();
+  // rows are added while the response is still being received
+  raw_client.get_submissions(*subs_doc_ptr,
+    [&scores](const char *json, size_t length) {
+      submission_from_json_text(scores, json, length);
+    }, course_name, asmt_name);
+
+  on_response([subs_doc_ptr]() {
+    rapidjson::Document &subs_doc = *subs_doc_ptr;
+    check_for_error_response(subs_doc);
+
+    require_is_array(subs_doc);
+  });
 }
 
 void Client::get_feedback(std::string &feedback, const std::string &course_name,
     const std::string &asmt_name, int sub_version, const std::string &problem_name) {
-  rapidjson::Document feedback_doc;
-  raw_client.get_feedback(feedback_doc, course_name, asmt_name, sub_version, problem_name);
-  check_for_error_response(feedback_doc);
+  std::shared_ptr<rapidjson::Document> feedback_doc_ptr = raw_client.new_response();
+  raw_client.get_feedback(*feedback_doc_ptr, course_name, asmt_name, sub_version, problem_name);
 
-  require_is_object(feedback_doc);
-  feedback = get_string_force(feedback_doc, "feedback");
+  on_response([&feedback, feedback_doc_ptr]() {
+    rapidjson::Document &feedback_doc = *feedback_doc_ptr;
+    check_for_error_response(feedback_doc);
+
+    require_is_object(feedback_doc);
+    feedback = get_string_force(feedback_doc, "feedback");
+  });
 }
 
 void Client::get_enrollments(std::vector<Enrollment> &enrollments, const std::string &course_name) {
-  rapidjson::Document enrolls_doc;
-  raw_client.get_enrollments(enrolls_doc, course_name);
-  check_for_error_response(enrolls_doc);
+  for_each_enrollment(course_name, [&enrollments](Enrollment &enrollment) {
+    enrollments.push_back(enrollment);
+  });
+}
 
-  require_is_array(enrolls_doc);
-  for (auto &e_doc : enrolls_doc.GetArray()) {
-    Enrollment enrollment;
-    enrollment_from_json(enrollment, e_doc);
+/* views */
+void Client::get_courses(ViewList<CourseView> &courses) {
+  std::shared_ptr<rapidjson::Document> courses_doc_ptr = raw_client.new_response();
+  raw_client.get_courses(*courses_doc_ptr);
 
-    enrollments.push_back(enrollment);
-  }
+  on_response([&courses, courses_doc_ptr]() {
+    check_for_error_response(*courses_doc_ptr);
+
+    require_is_array(*courses_doc_ptr);
+    courses.assign(courses_doc_ptr);
+  });
+}
+
+void Client::get_assessments(ViewList<AssessmentView> &asmts, const std::string &course_name) {
+  std::shared_ptr<rapidjson::Document> asmts_doc_ptr = raw_client.new_response();
+  raw_client.get_assessments(*asmts_doc_ptr, course_name);
+
+  on_response([&asmts, asmts_doc_ptr]() {
+    check_for_error_response(*asmts_doc_ptr);
+
+    require_is_array(*asmts_doc_ptr);
+    asmts.assign(asmts_doc_ptr);
+  });
+}
+
+void Client::get_problems(ViewList<ProblemView> &probs, const std::string &course_name,
+    const std::string &asmt_name) {
+  std::shared_ptr<rapidjson::Document> probs_doc_ptr = raw_client.new_response();
+  raw_client.get_problems(*probs_doc_ptr, course_name, asmt_name);
+
+  on_response([&probs, probs_doc_ptr]() {
+    check_for_error_response(*probs_doc_ptr);
+
+    require_is_array(*probs_doc_ptr);
+    probs.assign(probs_doc_ptr);
+  });
+}
+
+/* streaming */
+void Client::for_each_submission(const std::string &course_name,
+    const std::string &asmt_name, std::function<void(Submission &)> visitor) {
+  std::shared_ptr<rapidjson::Document> subs_doc_ptr = raw_client.new_response();
+  // elements are decoded while the response is still being received
+  raw_client.get_submissions(*subs_doc_ptr,
+    [visitor](const char *json, size_t length) {
+      Submission sub;
+      submission_from_json_text(sub, json, length);
+      visitor(sub);
+    }, course_name, asmt_name);
+
+  on_response([subs_doc_ptr]() {
+    rapidjson::Document &subs_doc = *subs_doc_ptr;
+    check_for_error_response(subs_doc);
+
+    require_is_array(subs_doc);
+  });
+}
+
+void Client::for_each_enrollment(const std::string &course_name,
+    std::function<void(Enrollment &)> visitor) {
+  std::shared_ptr<rapidjson::Document> enrolls_doc_ptr = raw_client.new_response();
+  // elements are decoded while the response is still being received
+  raw_client.get_enrollments(*enrolls_doc_ptr,
+    [visitor](const char *json, size_t length) {
+      Enrollment enrollment;
+      enrollment_from_json_text(enrollment, json, length);
+      visitor(enrollment);
+    }, course_name);
+
+  on_response([enrolls_doc_ptr]() {
+    rapidjson::Document &enrolls_doc = *enrolls_doc_ptr;
+    check_for_error_response(enrolls_doc);
+
+    require_is_array(enrolls_doc);
+  });
 }
 
 void Client::crud_enrollment(Enrollment &result, const std::string &course_name,
@@ -252,36 +452,50 @@ void Client::crud_enrollment(Enrollment &result, const std::string &course_name,
           Utility::authorization_level_to_string(input.auth_level.SOME)));
   }
 
-  rapidjson::Document enroll_doc;
-  raw_client.crud_enrollment(enroll_doc, course_name, email, in_params, action);
-  check_for_error_response(enroll_doc);
+  std::shared_ptr<rapidjson::Document> enroll_doc_ptr = raw_client.new_response();
+  raw_client.crud_enrollment(*enroll_doc_ptr, course_name, email, in_params, action);
+
+  on_response([&result, enroll_doc_ptr]() {
+    rapidjson::Document &enroll_doc = *enroll_doc_ptr;
+    check_for_error_response(enroll_doc);
 
-  require_is_object(enroll_doc);
-  enrollment_from_json(result, enroll_doc);
+    require_is_object(enroll_doc);
+    rapidjson_value enroll_value(enroll_doc);
+    enrollment_from_json(result, enroll_value);
+  });
 }
 
 
 void Client::download_handout(Attachment &handout, std::string download_dir,
     const std::string &course_name, const std::string &asmt_name) {
-  rapidjson::Document response_doc;
-  raw_client.download_handout(response_doc, download_dir, course_name, asmt_name);
-  check_for_error_response(response_doc);
+  std::shared_ptr<rapidjson::Document> response_doc_ptr = raw_client.new_response();
+  raw_client.download_handout(*response_doc_ptr, download_dir, course_name, asmt_name);
 
-  download_response_to_attachment_format(handout, response_doc);
+  on_response([&handout, response_doc_ptr]() {
+    rapidjson::Document &response_doc = *response_doc_ptr;
+    check_for_error_response(response_doc);
+
+    download_response_to_attachment_format(handout, response_doc);
+  });
 }
 
 void Client::download_writeup(Attachment &writeup, std::string download_dir,
     const std::string &course_name, const std::string &asmt_name) {
-  rapidjson::Document response_doc;
-  raw_client.download_writeup(response_doc, download_dir, course_name, asmt_name);
-  check_for_error_response(response_doc);
+  std::shared_ptr<rapidjson::Document> response_doc_ptr = raw_client.new_response();
+  raw_client.download_writeup(*response_doc_ptr, download_dir, course_name, asmt_name);
+
+  on_response([&writeup, response_doc_ptr]() {
+    rapidjson::Document &response_doc = *response_doc_ptr;
+    check_for_error_response(response_doc);
 
-  download_response_to_attachment_format(writeup, response_doc);
+    download_response_to_attachment_format(writeup, response_doc);
+  });
 }
 
 int Client::submit_assessment(const std::string &course_name, const std::string &asmt_name,
       std::string filename) {
-  rapidjson::Document response_doc;
+  std::shared_ptr<rapidjson::Document> response_doc_ptr = raw_client.new_response();
+  rapidjson::Document &response_doc = *response_doc_ptr;
   raw_client.submit_assessment(response_doc, course_name, asmt_name, filename);
   check_for_error_response(response_doc);
 
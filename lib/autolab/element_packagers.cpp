@@ -0,0 +1,124 @@
+#include "element_packagers.h"
+
+#include <cmath>
+
+#include <string>
+#include <utility>
+
+#include "autolab/autolab.h"
+#include "json_fields.h"
+
+namespace Autolab {
+
+/* submissions */
+
+// scores go into sub.scores, or into a row of matrix if one is given.
+struct submission_target {
+  Submission sub;
+  ScoreMatrix *matrix;
+  size_t row;
+  bool has_scores;
+
+  submission_target(ScoreMatrix *m, size_t r) :
+    matrix(m), row(r), has_scores(false) {}
+};
+
+struct scores_visitor : public json_member_visitor {
+  submission_target &target;
+  // number of scores seen so far, the column the next one is expected in
+  size_t score_index;
+
+  explicit scores_visitor(submission_target &t) : target(t), score_index(0) {}
+
+  void member(const char *key, size_t length, json_value &value) override {
+    double score;
+    if (!value.get_double(score)) score = std::nan(""); // unreleased
+
+    if (!target.matrix) {
+      target.sub.scores[std::string(key, length)] = score;
+      return;
+    }
+    size_t col = target.matrix->intern_problem(key, length, score_index++);
+    target.matrix->set_score(target.row, col, score);
+  }
+};
+
+// A missing or mistyped scores object is reported after the other fields, see
+// decode_submission.
+static const char *json_scores(submission_target &result, json_value *value) {
+  if (!value) return "object";
+  scores_visitor visitor(result);
+  result.has_scores = value->visit_members(visitor);
+  return result.has_scores ? nullptr : "object";
+}
+
+template <const char *(*Store)(Submission &, json_value *)>
+const char *target_sub(submission_target &result, json_value *value) {
+  return json_nested<submission_target, Submission, &submission_target::sub, Store>(result, value);
+}
+const json_field<submission_target> submission_fields[] = {
+  {"version",    field_required, target_sub<json_int<Submission, &Submission::version, 0>>},
+  {"created_at", field_required, target_sub<json_time<Submission, &Submission::created_at>>},
+  {"filename",   field_optional, target_sub<json_string<Submission, &Submission::filename>>},
+  {"scores",     field_optional, json_scores}
+};
+
+static void decode_submission(submission_target &target, const char *json, size_t length) {
+  parse_element(json, length, [&target](json_value &value) {
+    decode_object(target, value, submission_fields);
+  });
+  require_or_throw_invalid_response(target.has_scores,
+    "Expected json object not found");
+}
+
+void submission_from_json_text(Submission &sub, const char *json, size_t length) {
+  submission_target target(nullptr, 0);
+  decode_submission(target, json, length);
+  sub = std::move(target.sub);
+}
+
+void submission_from_json_text(ScoreMatrix &scores, const char *json, size_t length) {
+  submission_target target(&scores, scores.add_submission(0, 0, std::string()));
+  try {
+    decode_submission(target, json, length);
+  } catch (...) {
+    scores.remove_last_submission();
+    throw;
+  }
+  Submission &sub = target.sub;
+  scores.set_submission(target.row, sub.version, sub.created_at, sub.filename);
+}
+
+/* enrollments */
+
+// the user's fields are stored in the enrollment object itself
+template <const char *(*Store)(User &, json_value *)>
+const char *enrollment_user(Enrollment &result, json_value *value) {
+  return json_nested<Enrollment, User, &Enrollment::user, Store>(result, value);
+}
+const json_field<Enrollment> enrollment_fields[] = {
+  {"lecture",      field_optional, json_string<Enrollment, &Enrollment::lecture>},
+  {"section",      field_optional, json_string<Enrollment, &Enrollment::section>},
+  {"grade_policy", field_optional, json_string<Enrollment, &Enrollment::grade_policy>},
+  {"nickname",     field_optional, json_string<Enrollment, &Enrollment::nickname>},
+  {"dropped",      field_optional, json_bool<Enrollment, &Enrollment::dropped, false>},
+  {"auth_level",   field_required, json_auth_level<Enrollment, &Enrollment::auth_level>},
+  {"first_name",   field_required, enrollment_user<json_string<User, &User::first_name>>},
+  {"last_name",    field_required, enrollment_user<json_string<User, &User::last_name>>},
+  {"email",        field_required, enrollment_user<json_string<User, &User::email>>},
+  {"school",       field_optional, enrollment_user<json_string<User, &User::school>>},
+  {"major",        field_optional, enrollment_user<json_string<User, &User::major>>},
+  {"year",         field_optional, enrollment_user<json_string<User, &User::year>>}
+};
+
+void enrollment_from_json(Enrollment &enrollment, json_value &value) {
+  decode_object(enrollment, value, enrollment_fields);
+}
+
+void enrollment_from_json_text(Enrollment &enrollment, const char *json, size_t length) {
+  parse_element(json, length, [&enrollment](json_value &value) {
+    enrollment_from_json(enrollment, value);
+  });
+}
+
+}
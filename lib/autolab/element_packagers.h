@@ -0,0 +1,43 @@
+/*
+ * Packagers that decode the json text of a single array element straight into
+ * the result struct. Used for the elements streamed out of large array
+ * responses.
+ *
+ * The element is parsed by the backend chosen with -Djson_backend, rapidjson
+ * in rapidjson_packagers.cpp or simdjson in simdjson_packagers.cpp, and
+ * decoded with the same field tables as the documents in client.cpp, see
+ * element_packagers.cpp. They accept and reject the same input, and throw the
+ * same exceptions.
+ */
+
+#ifndef LIBAUTOLAB_ELEMENT_PACKAGERS_H_
+#define LIBAUTOLAB_ELEMENT_PACKAGERS_H_
+
+#include <cstddef>
+
+#include <functional>
+
+#include "autolab/autolab.h"
+#include "json_fields.h"
+
+namespace Autolab {
+
+void submission_from_json_text(Submission &sub, const char *json, size_t length);
+// appends the submission as a new row
+void submission_from_json_text(ScoreMatrix &scores, const char *json, size_t length);
+void enrollment_from_json_text(Enrollment &enrollment, const char *json, size_t length);
+
+// also used for the enrollments returned by crud_enrollment
+void enrollment_from_json(Enrollment &enrollment, json_value &value);
+
+/* backends */
+
+// Parses the json text of an element and passes its value to decode. Throws
+// InvalidResponseException if the text isn't valid json. The value is only
+// valid during the call.
+void parse_element(const char *json, size_t length,
+    const std::function<void(json_value &)> &decode);
+
+}
+
+#endif /* LIBAUTOLAB_ELEMENT_PACKAGERS_H_ */
@@ -0,0 +1,230 @@
+/*
+ * Field descriptor tables for decoding json objects into the structs in
+ * autolab.h.
+ *
+ * A table lists, for each json key of a struct, whether it is required and a
+ * store function that converts the value into the right member. decode_object
+ * walks the members of a json object once, finds each key in the table and
+ * stores its value, instead of searching the object again for every field.
+ * Missing and mistyped fields are reported with the same exceptions as the
+ * get_*_force helpers, checked in table order.
+ *
+ * The values are read through json_value, so that the same tables decode the
+ * documents parsed with rapidjson and the elements parsed with simdjson. This
+ * header doesn't depend on either parser.
+ */
+
+#ifndef LIBAUTOLAB_JSON_FIELDS_H_
+#define LIBAUTOLAB_JSON_FIELDS_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <string>
+
+#include "autolab/autolab.h"
+
+// errors raised when a value is missing or invalid, see json_helpers.cpp
+void require_or_throw_invalid_response(bool guard, std::string msg);
+void throw_unexpected_null_error(std::string key, std::string expected_type);
+
+namespace Autolab {
+
+class json_value;
+
+class json_member_visitor {
+public:
+  virtual void member(const char *key, size_t length, json_value &value) = 0;
+
+protected:
+  ~json_member_visitor() {}
+};
+
+/* A json value of either parser, see rapidjson_value in json_helpers.h and
+ * ondemand_value in simdjson_packagers.cpp. Each get_* function stores the
+ * value and returns true if it has that type, and returns false otherwise.
+ * The types are rapidjson's: an int is an integer that fits into an int, and a
+ * double a number written with a fraction or an exponent.
+ */
+class json_value {
+public:
+  virtual bool get_string(const char *&str, size_t &length) = 0;
+  virtual bool get_int(int &result) = 0;
+  virtual bool get_double(double &result) = 0;
+  virtual bool get_bool(bool &result) = 0;
+  // calls visitor.member for each member in order, or returns false if the
+  // value isn't an object
+  virtual bool visit_members(json_member_visitor &visitor) = 0;
+
+protected:
+  ~json_value() {}
+};
+
+enum field_presence {field_optional, field_required};
+
+constexpr size_t key_length(const char *key) {
+  return *key ? 1 + key_length(key + 1) : 0;
+}
+
+template <typename T>
+struct json_field {
+  // Stores value into the member of result. If value is null (the key is
+  // missing) or of a different type, the member's fallback is stored instead
+  // and the name of the expected type is returned. Returns nullptr otherwise.
+  typedef const char *(*store_function)(T &result, json_value *value);
+
+  const char *key;
+  size_t length;
+  field_presence presence;
+  store_function store;
+
+  constexpr json_field(const char *k, field_presence p, store_function s) :
+    key(k), length(key_length(k)), presence(p), store(s) {}
+};
+
+/* store functions */
+
+template <typename T, std::string T::*Member>
+const char *json_string(T &result, json_value *value) {
+  const char *str;
+  size_t length;
+  if (value && value->get_string(str, length)) {
+    (result.*Member).assign(str, length);
+    return nullptr;
+  }
+  (result.*Member).clear();
+  return "string";
+}
+
+template <typename T, int T::*Member, int Fallback>
+const char *json_int(T &result, json_value *value) {
+  if (value && value->get_int(result.*Member)) return nullptr;
+  result.*Member = Fallback;
+  return "int";
+}
+
+// the fallback is always NaN
+template <typename T, double T::*Member>
+const char *json_double(T &result, json_value *value) {
+  if (value && value->get_double(result.*Member)) return nullptr;
+  result.*Member = std::nan("");
+  return "double";
+}
+
+template <typename T, bool T::*Member, bool Fallback>
+const char *json_bool(T &result, json_value *value) {
+  if (value && value->get_bool(result.*Member)) return nullptr;
+  result.*Member = Fallback;
+  return "bool";
+}
+
+// time strings, see Utility::string_to_time. The fallback is 0.
+template <typename T, std::time_t T::*Member>
+const char *json_time(T &result, json_value *value) {
+  const char *str;
+  size_t length;
+  if (value && value->get_string(str, length)) {
+    result.*Member = Utility::string_to_time(str, length);
+    return nullptr;
+  }
+  result.*Member = 0;
+  return "string";
+}
+
+template <typename T, AuthorizationLevel T::*Member>
+const char *json_auth_level(T &result, json_value *value) {
+  const char *str;
+  size_t length;
+  if (value && value->get_string(str, length)) {
+    result.*Member = Utility::string_to_authorization_level(std::string(str, length));
+    return nullptr;
+  }
+  result.*Member = AuthorizationLevel::student;
+  return "string";
+}
+
+template <typename T, AttachmentFormat T::*Member>
+const char *json_attachment_format(T &result, json_value *value) {
+  const char *str;
+  size_t length;
+  if (value && value->get_string(str, length)) {
+    result.*Member = Utility::string_to_attachment_format(std::string(str, length));
+    return nullptr;
+  }
+  result.*Member = AttachmentFormat::none;
+  return "string";
+}
+
+// a field of a struct nested in T, e.g. the user of an enrollment, that is
+// stored in the same json object as T's own fields.
+template <typename T, typename Nested, Nested T::*Member,
+          const char *(*Store)(Nested &, json_value *)>
+const char *json_nested(T &result, json_value *value) {
+  return Store(result.*Member, value);
+}
+
+/* decoding */
+
+// index of the field with the given key, or count if there is none. Only keys
+// of the same length are compared.
+template <typename T>
+size_t find_field(const json_field<T> *fields, size_t count,
+    const char *key, size_t length) {
+  for (size_t i = 0; i < count; i++) {
+    if (fields[i].length == length &&
+        std::memcmp(fields[i].key, key, length) == 0) {
+      return i;
+    }
+  }
+  return count;
+}
+
+// stores the members found in a table, see decode_object
+template <typename T, size_t N>
+struct field_visitor : public json_member_visitor {
+  T &result;
+  const json_field<T> (&fields)[N];
+  uint32_t found;
+  // expected type of each found field whose value had a different type
+  const char *mismatch[N];
+
+  field_visitor(T &r, const json_field<T> (&f)[N]) :
+    result(r), fields(f), found(0), mismatch() {}
+
+  void member(const char *key, size_t length, json_value &value) override {
+    size_t i = find_field(fields, N, key, length);
+    // unknown key, or a duplicate where the first occurrence counts
+    if (i == N || (found & (1u << i))) return;
+    found |= 1u << i;
+    mismatch[i] = fields[i].store(result, &value);
+  }
+};
+
+template <typename T, size_t N>
+void decode_object(T &result, json_value &obj, const json_field<T> (&fields)[N]) {
+  static_assert(N <= 32, "found fields are tracked in a 32-bit mask");
+
+  field_visitor<T, N> visitor(result, fields);
+  require_or_throw_invalid_response(obj.visit_members(visitor),
+    "Expected json object not found");
+
+  for (size_t i = 0; i < N; i++) {
+    const json_field<T> &field = fields[i];
+    if (!(visitor.found & (1u << i))) {
+      if (field.presence == field_required) {
+        throw InvalidResponseException(std::string("Expected key ") +
+          field.key + " not found in json object.");
+      }
+      field.store(result, nullptr);
+    } else if (visitor.mismatch[i] && field.presence == field_required) {
+      throw_unexpected_null_error(field.key, visitor.mismatch[i]);
+    }
+  }
+}
+
+}
+
+#endif /* LIBAUTOLAB_JSON_FIELDS_H_ */
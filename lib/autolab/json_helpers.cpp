@@ -27,71 +27,75 @@ void require_is_object(rapidjson::Value &obj) {
   require_or_throw_invalid_response(obj.IsObject(), "Expected json object not found");
 }
 
-void require_key_exists(rapidjson::Value &obj, std::string key) {
-  require_or_throw_invalid_response(obj.HasMember(key.c_str()),
-    "Expected key " + key + " not found in json object.");
+void require_key_exists(rapidjson::Value &obj, const char *key) {
+  require_or_throw_invalid_response(obj.HasMember(key),
+    std::string("Expected key ") + key + " not found in json object.");
 }
 
 // Methods for getting basic types from objects: Bool, Double, Int, String
-bool get_bool_internal(rapidjson::Value &obj, std::string key, bool &result) {
-  if (!obj.HasMember(key.c_str())) return false;
-  rapidjson::Value &candidate = obj[key.c_str()];
+bool get_bool_internal(rapidjson::Value &obj, const char *key, bool &result) {
+  rapidjson::Value::MemberIterator it = obj.FindMember(key);
+  if (it == obj.MemberEnd()) return false;
+  rapidjson::Value &candidate = it->value;
   if (candidate.IsBool()) {
     result = candidate.GetBool();
     return true;
   }
   return false;
 }
-bool get_double_internal(rapidjson::Value &obj, std::string key, double &result) {
-  if (!obj.HasMember(key.c_str())) return false;
-  rapidjson::Value &candidate = obj[key.c_str()];
+bool get_double_internal(rapidjson::Value &obj, const char *key, double &result) {
+  rapidjson::Value::MemberIterator it = obj.FindMember(key);
+  if (it == obj.MemberEnd()) return false;
+  rapidjson::Value &candidate = it->value;
   if (candidate.IsDouble()) {
     result = candidate.GetDouble();
     return true;
   }
   return false;
 }
-bool get_int_internal(rapidjson::Value &obj, std::string key, int &result) {
-  if (!obj.HasMember(key.c_str())) return false;
-  rapidjson::Value &candidate = obj[key.c_str()];
+bool get_int_internal(rapidjson::Value &obj, const char *key, int &result) {
+  rapidjson::Value::MemberIterator it = obj.FindMember(key);
+  if (it == obj.MemberEnd()) return false;
+  rapidjson::Value &candidate = it->value;
   if (candidate.IsInt()) {
     result = candidate.GetInt();
     return true;
   }
   return false;
 }
-bool get_string_internal(rapidjson::Value &obj, std::string key, std::string &result) {
-  if (!obj.HasMember(key.c_str())) return false;
-  rapidjson::Value &candidate = obj[key.c_str()];
+bool get_string_internal(rapidjson::Value &obj, const char *key, std::string &result) {
+  rapidjson::Value::MemberIterator it = obj.FindMember(key);
+  if (it == obj.MemberEnd()) return false;
+  rapidjson::Value &candidate = it->value;
   if (candidate.IsString()) {
-    result = candidate.GetString();
+    result.assign(candidate.GetString(), candidate.GetStringLength());
     return true;
   }
   return false;
 }
 
-bool get_bool(rapidjson::Value &obj, std::string key, bool fallback) {
+bool get_bool(rapidjson::Value &obj, const char *key, bool fallback) {
   bool result = fallback;
   if (get_bool_internal(obj, key, result)) return result;
   return fallback;
 }
-double get_double(rapidjson::Value &obj, std::string key, double fallback) {
+double get_double(rapidjson::Value &obj, const char *key, double fallback) {
   double result = fallback;
   if (get_double_internal(obj, key, result)) return result;
   return fallback;
 }
-int get_int(rapidjson::Value &obj, std::string key, int fallback) {
+int get_int(rapidjson::Value &obj, const char *key, int fallback) {
   int result = fallback;
   if (get_int_internal(obj, key, result)) return result;
   return fallback;
 }
-std::string get_string(rapidjson::Value &obj, std::string key, std::string fallback) {
+std::string get_string(rapidjson::Value &obj, const char *key, std::string fallback) {
   std::string result = fallback;
   if (get_string_internal(obj, key, result)) return result;
   return fallback;
 }
 
-bool get_bool_force(rapidjson::Value &obj, std::string key) {
+bool get_bool_force(rapidjson::Value &obj, const char *key) {
   bool result = true;
   require_key_exists(obj, key);
   if (!get_bool_internal(obj, key, result)) {
@@ -99,7 +103,7 @@ bool get_bool_force(rapidjson::Value &obj, std::string key) {
   }
   return result;
 }
-double get_double_force(rapidjson::Value &obj, std::string key) {
+double get_double_force(rapidjson::Value &obj, const char *key) {
   double result = 0;
   require_key_exists(obj, key);
   if (!get_double_internal(obj, key, result)) {
@@ -107,7 +111,7 @@ double get_double_force(rapidjson::Value &obj, std::string key) {
   }
   return result;
 }
-int get_int_force(rapidjson::Value &obj, std::string key) {
+int get_int_force(rapidjson::Value &obj, const char *key) {
   int result = 0;
   require_key_exists(obj, key);
   if (!get_int_internal(obj, key, result)) {
@@ -115,11 +119,49 @@ int get_int_force(rapidjson::Value &obj, std::string key) {
   }
   return result;
 }
-std::string get_string_force(rapidjson::Value &obj, std::string key) {
+std::string get_string_force(rapidjson::Value &obj, const char *key) {
   std::string result;
   require_key_exists(obj, key);
   if (!get_string_internal(obj, key, result)) {
     throw_unexpected_null_error(key, "string");
   }
   return result;
-}
\ No newline at end of file
+}
+namespace Autolab {
+
+bool rapidjson_value::get_string(const char *&str, size_t &length) {
+  if (!value.IsString()) return false;
+  str = value.GetString();
+  length = value.GetStringLength();
+  return true;
+}
+
+bool rapidjson_value::get_int(int &result) {
+  if (!value.IsInt()) return false;
+  result = value.GetInt();
+  return true;
+}
+
+bool rapidjson_value::get_double(double &result) {
+  if (!value.IsDouble()) return false;
+  result = value.GetDouble();
+  return true;
+}
+
+bool rapidjson_value::get_bool(bool &result) {
+  if (!value.IsBool()) return false;
+  result = value.GetBool();
+  return true;
+}
+
+bool rapidjson_value::visit_members(json_member_visitor &visitor) {
+  if (!value.IsObject()) return false;
+  for (rapidjson::Value::MemberIterator m = value.MemberBegin();
+       m != value.MemberEnd(); ++m) {
+    rapidjson_value member_value(m->value);
+    visitor.member(m->name.GetString(), m->name.GetStringLength(), member_value);
+  }
+  return true;
+}
+
+}
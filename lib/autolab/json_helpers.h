@@ -7,8 +7,13 @@
 
 #include <cmath>
 
+#include <string>
+
 #include <rapidjson/document.h>
 
+// also declares the errors raised by the helpers below
+#include "json_fields.h"
+
 void require_is_array(rapidjson::Value &obj);
 void require_is_object(rapidjson::Value &obj);
 
@@ -17,16 +22,41 @@ void require_is_object(rapidjson::Value &obj);
 //   get_string: empty string ""
 //   get_double: NaN
 // All other functions require a fallback value.
-bool get_bool(rapidjson::Value &obj, std::string key, bool fallback);
-double get_double(rapidjson::Value &obj, std::string key,
+bool get_bool(rapidjson::Value &obj, const char *key, bool fallback);
+double get_double(rapidjson::Value &obj, const char *key,
     double fallback = std::nan(""));
-int get_int(rapidjson::Value &obj, std::string key, int fallback);
-std::string get_string(rapidjson::Value &obj, std::string key, 
+int get_int(rapidjson::Value &obj, const char *key, int fallback);
+std::string get_string(rapidjson::Value &obj, const char *key, 
     std::string fallback = std::string());
 
-bool get_bool_force(rapidjson::Value &obj, std::string key);
-double get_double_force(rapidjson::Value &obj, std::string key);
-int get_int_force(rapidjson::Value &obj, std::string key);
-std::string get_string_force(rapidjson::Value &obj, std::string key);
+bool get_bool_force(rapidjson::Value &obj, const char *key);
+double get_double_force(rapidjson::Value &obj, const char *key);
+int get_int_force(rapidjson::Value &obj, const char *key);
+std::string get_string_force(rapidjson::Value &obj, const char *key);
+
+namespace Autolab {
+
+// a value of a rapidjson document, for decode_object
+class rapidjson_value : public json_value {
+public:
+  explicit rapidjson_value(rapidjson::Value &v) : value(v) {}
+
+  bool get_string(const char *&str, size_t &length) override;
+  bool get_int(int &result) override;
+  bool get_double(double &result) override;
+  bool get_bool(bool &result) override;
+  bool visit_members(json_member_visitor &visitor) override;
+
+private:
+  rapidjson::Value &value;
+};
+
+template <typename T, size_t N>
+void decode_object(T &result, rapidjson::Value &obj, const json_field<T> (&fields)[N]) {
+  rapidjson_value value(obj);
+  decode_object(result, value, fields);
+}
+
+}
 
 #endif /* LIBAUTOLAB_JSON_HELPERS_H_ */
\ No newline at end of file
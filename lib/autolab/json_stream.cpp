@@ -0,0 +1,137 @@
+#include "json_stream.h"
+
+#include <cstddef>
+
+#include <string>
+
+namespace Autolab {
+
+bool is_json_whitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+json_array_splitter::json_array_splitter(element_callback cb,
+  std::string &fallback_output)
+  : on_element(cb), fallback(fallback_output)
+{
+  reset();
+}
+
+void json_array_splitter::reset() {
+  state = not_started;
+  partial.clear();
+  depth = 0;
+  in_string = false;
+  escaped = false;
+}
+
+// hand data[start, end) to the callback, joined with what was received of the
+// element in previous chunks.
+void json_array_splitter::emit(const char *data, size_t start, size_t end) {
+  if (partial.empty()) {
+    on_element(data + start, end - start);
+    return;
+  }
+  partial.append(data + start, end - start);
+  on_element(partial.data(), partial.length());
+  partial.clear();
+}
+
+void json_array_splitter::separator(char c) {
+  if (is_json_whitespace(c)) return;
+  if (c == ',' && state == after_element) {
+    state = before_element;
+  } else if (c == ']' && (state == after_element || state == before_first_element)) {
+    state = done;
+  } else {
+    state = malformed;
+  }
+}
+
+void json_array_splitter::feed(const char *data, size_t length) {
+  // where the current element starts in this chunk
+  size_t element_start = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    char c = data[i];
+
+    if (state == malformed) return;
+    if (state == done) {
+      if (!is_json_whitespace(c)) state = malformed;
+      continue;
+    }
+    if (state == not_array) {
+      fallback.append(data + i, length - i);
+      return;
+    }
+    if (state == not_started) {
+      if (is_json_whitespace(c)) continue;
+      if (c != '[') {
+        state = not_array;
+        fallback.append(data + i, length - i);
+        return;
+      }
+      state = before_first_element;
+      continue;
+    }
+    if (state != in_element) {
+      if (is_json_whitespace(c) || c == ',' || c == ']' || c == '}') {
+        separator(c);
+        continue;
+      }
+      if (state == after_element) {
+        // two elements without a comma between them
+        state = malformed;
+        return;
+      }
+      // first character of a new element
+      state = in_element;
+      element_start = i;
+      depth = 0;
+    }
+
+    // inside an element
+    if (in_string) {
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        in_string = false;
+        if (depth == 0) {
+          // the element is a string
+          emit(data, element_start, i + 1);
+          state = after_element;
+        }
+      }
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        // end of the array right after a number or literal
+        emit(data, element_start, i);
+        state = after_element;
+        separator(c);
+        continue;
+      }
+      depth--;
+      if (depth == 0) {
+        emit(data, element_start, i + 1);
+        state = after_element;
+      }
+    } else if (depth == 0 && (c == ',' || is_json_whitespace(c))) {
+      // end of a number or literal
+      emit(data, element_start, i);
+      state = after_element;
+      separator(c);
+    }
+  }
+
+  if (state == in_element) {
+    partial.append(data + element_start, length - element_start);
+  }
+}
+
+}
@@ -0,0 +1,71 @@
+/*
+ * Splits a json array into its elements while it is being received.
+ *
+ * Bytes are fed in chunks of any size as they arrive from the network. Each
+ * element of the top-level array is handed to the callback as soon as its last
+ * byte has been fed, so decoding can overlap the transfer and only the element
+ * currently being received has to be buffered. If the document turns out not
+ * to be an array (e.g. an error object), it is collected into the fallback
+ * string instead, to be parsed the regular way.
+ *
+ * Only the structure of the array is checked: where its commas are, that it
+ * is closed, and that nothing but whitespace follows it. The elements are
+ * checked by whoever decodes them.
+ */
+
+#ifndef LIBAUTOLAB_JSON_STREAM_H_
+#define LIBAUTOLAB_JSON_STREAM_H_
+
+#include <cstddef>
+
+#include <functional>
+#include <string>
+
+namespace Autolab {
+
+class json_array_splitter {
+public:
+  typedef std::function<void(const char *, size_t)> element_callback;
+
+  json_array_splitter(element_callback cb, std::string &fallback_output);
+
+  void feed(const char *data, size_t length);
+  void reset();
+
+  // whether the document fed so far is a json array
+  bool is_array() { return state != not_array && state != not_started; }
+  // whether the array was well-formed and closed, once everything was fed.
+  // A body cut off in the middle, or with stray commas or bytes after the
+  // array, is not.
+  bool complete() { return state == done && partial.empty(); }
+
+private:
+  enum splitter_state {
+    not_started,
+    not_array,
+    before_first_element, // after '['
+    before_element,       // after ','
+    after_element,        // expecting ',' or ']'
+    in_element,
+    done,                 // only whitespace may follow
+    malformed,
+  };
+
+  element_callback on_element;
+  std::string &fallback;
+
+  splitter_state state;
+  // part of the current element received in previous chunks
+  std::string partial;
+  int depth;
+  bool in_string;
+  bool escaped;
+
+  void emit(const char *data, size_t start, size_t end);
+  // handles c right after an element, or in place of one
+  void separator(char c);
+};
+
+}
+
+#endif /* LIBAUTOLAB_JSON_STREAM_H_ */
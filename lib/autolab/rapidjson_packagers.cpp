@@ -0,0 +1,43 @@
+/*
+ * rapidjson backend of the element packagers in element_packagers.h, built
+ * unless configured with -Djson_backend=simdjson.
+ */
+
+#include "element_packagers.h"
+
+#include <rapidjson/document.h>
+
+#include "json_helpers.h"
+
+namespace Autolab {
+
+/* Each element is parsed into a document that is reused for every element of
+ * the thread. Its values are allocated from a buffer that is cleared before
+ * the next element, so that small elements don't allocate at all.
+ */
+struct element_document {
+  char buffer[16 * 1024];
+  rapidjson::MemoryPoolAllocator<> allocator;
+  rapidjson::Document doc;
+
+  element_document() : allocator(buffer, sizeof(buffer)), doc(&allocator) {}
+
+  rapidjson::Document &parse(const char *json, size_t length) {
+    doc.SetNull();
+    allocator.Clear();
+    return doc.Parse(json, length);
+  }
+};
+
+void parse_element(const char *json, size_t length,
+    const std::function<void(json_value &)> &decode) {
+  static thread_local element_document element;
+  rapidjson::Document &doc = element.parse(json, length);
+  require_or_throw_invalid_response(!doc.HasParseError(),
+    "Expected json object not found");
+
+  rapidjson_value value(doc);
+  decode(value);
+}
+
+}
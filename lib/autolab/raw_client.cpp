@@ -1,28 +1,93 @@
 #include "autolab/raw_client.h"
 
+#include <stdlib.h>   // mkstemp, getenv
+#include <strings.h>  // strncasecmp
+#include <sys/mman.h> // mmap
+#include <unistd.h>   // write, close, unlink
+
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <ctime>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <ostream>
+#include <sstream>
 #include <string>
 #include <thread> // sleep_for
+#include <vector>
 
 #include "autolab/autolab.h"
 #include "json_helpers.h"
+#include "json_stream.h"
 #include "logger.h"
+#include "response_cache.h"
 
 namespace Autolab {
 
 const std::chrono::seconds device_flow_authorize_wait_duration(5);
+// idle handles beyond this number are cleaned up instead of kept in the pool
+const std::size_t max_idle_handles = 4;
+// how long an exported server address may be used by later processes
+const std::time_t resolved_address_lifetime = 300; // seconds
+// response bodies above this size are spilled to disk, see set_spill_threshold
+const size_t default_spill_threshold = 8 << 20;
+// how long cached responses are fresh, and then served while stale. Problems
+// and assessment details rarely change, submissions often.
+const std::time_t cache_day = 24 * 60 * 60;
+const RawClient::CachePolicy default_cache_policies[RawClient::NumCachedResources] = {
+  {cache_day, 7 * cache_day}, // user info
+  {60 * 60, 7 * cache_day},   // courses
+  {60 * 60, 7 * cache_day},   // assessments
+  {cache_day, 7 * cache_day}, // assessment details
+  {cache_day, 7 * cache_day}, // problems
+  {30, 60 * 60},              // submissions
+  {30, 60 * 60},              // feedback
+  {5 * 60, cache_day},        // enrollments
+};
 
 /* initialization */
 int RawClient::curl_ready = false;
 
 RawClient::RawClient(const std::string &domain, const std::string &id,
   const std::string &st, const std::string &ru, void (*tk_cb)(std::string, std::string))
-  : base_uri(domain), new_tokens_callback(tk_cb), api_version(1),
-    client_id(id), client_secret(st), redirect_uri(ru)
+  : base_uri(domain), transfers_ready(false), share_handle(nullptr),
+    resolved_address_expiry(0), resolve_list(nullptr), num_transfers(0), num_new_connections(0), num_reused_connections(0),
+    num_bytes_received(0), num_bytes_decoded(0),
+    spill_threshold(default_spill_threshold), arenas(new arena_pool),
+    cache_bypass(false),
+    new_tokens_callback(tk_cb), new_expiring_tokens_callback(nullptr),
+    api_version(1), client_id(id), client_secret(st), redirect_uri(ru),
+    access_token_expires_at(0), token_loader(nullptr),
+    lock_token_storage(nullptr), unlock_token_storage(nullptr),
+    tokens_loaded(true)
 {
-  RawClient::init_curl();
+  std::copy(default_cache_policies, default_cache_policies + NumCachedResources,
+    cache_policies);
+}
+
+RawClient::RawClient(const std::string &domain, const std::string &id,
+  const std::string &st, const std::string &ru,
+  void (*tk_cb)(std::string, std::string, std::time_t))
+  : RawClient(domain, id, st, ru, (void (*)(std::string, std::string))nullptr)
+{
+  new_expiring_tokens_callback = tk_cb;
+}
+
+RawClient::~RawClient() {
+  for (CURLM *multi : idle_multi_handles) {
+    curl_multi_cleanup(multi);
+  }
+  for (CURL *curl : idle_handles) {
+    curl_easy_cleanup(curl);
+  }
+  // must be last, after all handles using it are gone
+  if (share_handle) curl_share_cleanup(share_handle);
+  if (resolve_list) curl_slist_free_all(resolve_list);
+  for (struct curl_slist *list : retired_resolve_lists) {
+    curl_slist_free_all(list);
+  }
 }
 
 int RawClient::init_curl() {
@@ -35,22 +100,606 @@ int RawClient::init_curl() {
   return 0;
 }
 
+// curl, and the caches shared by its handles, are only set up before the
+// first transfer, so processes that never use the network don't pay for it.
+void RawClient::init_transfers() {
+  if (transfers_ready) return;
+  std::lock_guard<std::mutex> guard(transfers_lock);
+  if (transfers_ready) return;
+  RawClient::init_curl();
+  init_share();
+  // set before importing, which acquires a handle and so comes back here
+  transfers_ready = true;
+
+  for (auto &entry : pending_tls_sessions) {
+    import_tls_session(entry);
+  }
+  pending_tls_sessions.clear();
+}
+
+/* Shared caches */
+
+void RawClient::lock_share(CURL *, curl_lock_data data, curl_lock_access,
+  void *client)
+{
+  static_cast<RawClient *>(client)->share_locks[data].lock();
+}
+
+void RawClient::unlock_share(CURL *, curl_lock_data data, void *client) {
+  static_cast<RawClient *>(client)->share_locks[data].unlock();
+}
+
+// set up the share object. If this fails, every handle simply uses its own
+// caches instead.
+void RawClient::init_share() {
+  share_handle = curl_share_init();
+  if (!share_handle) return;
+
+  curl_share_setopt(share_handle, CURLSHOPT_LOCKFUNC, lock_share);
+  curl_share_setopt(share_handle, CURLSHOPT_UNLOCKFUNC, unlock_share);
+  curl_share_setopt(share_handle, CURLSHOPT_USERDATA, this);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900 /* 7.57.0 */
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+RawClient::connection_stats RawClient::get_connection_stats() {
+  connection_stats stats;
+  stats.transfers = num_transfers;
+  stats.new_connections = num_new_connections;
+  stats.reused_connections = num_reused_connections;
+  stats.bytes_received = num_bytes_received;
+  stats.bytes_decoded = num_bytes_decoded;
+  return stats;
+}
+
+/* Connection cache */
+
+// TLS sessions are only exported and imported by libcurl 8.12.0 and later
+#if LIBCURL_VERSION_NUM >= 0x080c00 /* 8.12.0 */
+static std::string to_hex(const unsigned char *data, size_t length) {
+  static const char digits[] = "0123456789abcdef";
+  if (!data || length == 0) return "-";
+  std::string result;
+  result.reserve(length * 2);
+  for (size_t i = 0; i < length; i++) {
+    result.push_back(digits[data[i] >> 4]);
+    result.push_back(digits[data[i] & 0xf]);
+  }
+  return result;
+}
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// decodes what to_hex wrote. Returns false if hex isn't valid.
+static bool from_hex(const std::string &hex, std::string &result) {
+  result.clear();
+  if (hex == "-") return true;
+  if (hex.length() % 2 != 0) return false;
+  result.reserve(hex.length() / 2);
+  for (size_t i = 0; i < hex.length(); i += 2) {
+    int high = hex_digit(hex[i]);
+    int low = hex_digit(hex[i + 1]);
+    if (high < 0 || low < 0) return false;
+    result.push_back((char)(high << 4 | low));
+  }
+  return true;
+}
+#endif
+
+// the host name part of a uri like "https://host:port/path"
+static std::string get_uri_host(const std::string &uri) {
+  std::string::size_type start = uri.find("://");
+  start = (start == std::string::npos) ? 0 : start + 3;
+  std::string::size_type end = uri.find_first_of(":/", start);
+  return uri.substr(start, end - start);
+}
+
+// record the address the server was reached at, unless it came from an
+// imported entry, which keeps its original expiry.
+void RawClient::remember_resolved_address(CURL *curl) {
+  std::lock_guard<std::mutex> guard(resolve_lock);
+  if (resolve_list) return;
+
+  char *ip = nullptr;
+  long port = 0;
+  curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip);
+  curl_easy_getinfo(curl, CURLINFO_PRIMARY_PORT, &port);
+  if (!ip || *ip == '\0' || port <= 0) return;
+
+  std::string address(ip);
+  if (address.find(':') != std::string::npos) {
+    address = "[" + address + "]"; // ipv6
+  }
+  resolved_address = get_uri_host(base_uri) + ":" + std::to_string(port) + ":" + address;
+  resolved_address_expiry = std::time(nullptr) + resolved_address_lifetime;
+}
+
+// stop using an imported address, e.g. because the server could not be
+// reached at it anymore.
+void RawClient::forget_resolved_address() {
+  std::lock_guard<std::mutex> guard(resolve_lock);
+  if (!resolve_list) return;
+  LogDebug("Dropping cached address " << resolved_address << Logger::endl);
+  retired_resolve_lists.push_back(resolve_list);
+  resolve_list = nullptr;
+  resolved_address.clear();
+}
+
+#if LIBCURL_VERSION_NUM >= 0x080c00 /* 8.12.0 */
+static CURLcode export_tls_session(CURL *, void *out,
+  const char *session_key, const unsigned char *shmac, size_t shmac_len,
+  const unsigned char *sdata, size_t sdata_len, curl_off_t valid_until,
+  int, const char *, size_t)
+{
+  std::string key = session_key ? session_key : "";
+  *static_cast<std::ostringstream *>(out) << "tls " << (long long)valid_until
+    << " " << to_hex((const unsigned char *)key.c_str(), key.length())
+    << " " << to_hex(shmac, shmac_len)
+    << " " << to_hex(sdata, sdata_len) << "\n";
+  return CURLE_OK;
+}
+#endif
+
+/* one entry per line:
+ *   resolve <expiry> <host:port:address>
+ *   tls <expiry> <hex session key> <hex shmac> <hex session data>
+ */
+std::string RawClient::export_connection_cache() {
+  std::ostringstream out;
+  {
+    std::lock_guard<std::mutex> guard(resolve_lock);
+    if (resolved_address.length() > 0) {
+      out << "resolve " << (long long)resolved_address_expiry << " "
+        << resolved_address << "\n";
+    }
+  }
+
+  {
+    // sessions imported before any transfer was made are passed on as they are
+    std::lock_guard<std::mutex> guard(transfers_lock);
+    for (auto &entry : pending_tls_sessions) {
+      out << entry << "\n";
+    }
+  }
+
+#if LIBCURL_VERSION_NUM >= 0x080c00 /* 8.12.0 */
+  if (share_handle) {
+    CURL *curl = acquire_handle();
+    CURLcode res = curl_easy_ssls_export(curl, export_tls_session, &out);
+    release_handle(curl);
+    if (res != CURLE_OK) {
+      LogDebug("TLS session export failed: " << curl_easy_strerror(res) << Logger::endl);
+    }
+  }
+#endif
+
+  return out.str();
+}
+
+void RawClient::import_connection_cache(const std::string &cache) {
+  std::istringstream in(cache);
+  std::string line;
+  long long now = std::time(nullptr);
+
+  while (std::getline(in, line)) {
+    std::istringstream entry(line);
+    std::string type;
+    long long expiry = 0;
+    entry >> type >> expiry;
+    if (!entry || expiry <= now) continue;
+
+    if (type == "resolve") {
+      std::string address;
+      entry >> address;
+      std::lock_guard<std::mutex> guard(resolve_lock);
+      if (address.length() == 0 || resolve_list) continue;
+      resolve_list = curl_slist_append(nullptr, address.c_str());
+      resolved_address = address;
+      resolved_address_expiry = expiry;
+      LogDebug("Using cached address " << address << Logger::endl);
+    }
+    else if (type == "tls") {
+      // imported into the share handle once it exists
+      std::lock_guard<std::mutex> guard(transfers_lock);
+      if (transfers_ready) {
+        import_tls_session(line);
+      } else {
+        pending_tls_sessions.push_back(line);
+      }
+    }
+  }
+}
+
+void RawClient::discard_inherited_connections() {
+  if (!transfers_ready) return;
+  // only reads the session cache of the share handle
+  std::string cache = export_connection_cache();
+  {
+    // not cleaned up, which could write to the parent's connections
+    std::lock_guard<std::mutex> guard(handles_lock);
+    idle_handles.clear();
+    idle_multi_handles.clear();
+  }
+  {
+    std::lock_guard<std::mutex> guard(transfers_lock);
+    share_handle = nullptr;
+    transfers_ready = false;
+  }
+  // the TLS sessions go into the new share handle
+  import_connection_cache(cache);
+  LogDebug("Discarded the connections inherited from the parent" << Logger::endl);
+}
+
+void RawClient::import_tls_session(const std::string &line) {
+#if LIBCURL_VERSION_NUM >= 0x080c00 /* 8.12.0 */
+  if (!share_handle) return;
+  std::istringstream entry(line);
+  std::string type, key_hex, shmac_hex, sdata_hex;
+  long long expiry;
+  entry >> type >> expiry >> key_hex >> shmac_hex >> sdata_hex;
+  if (!entry) return;
+  // a damaged entry is treated as no cached session
+  std::string key, shmac, sdata;
+  if (!from_hex(key_hex, key) || !from_hex(shmac_hex, shmac) ||
+      !from_hex(sdata_hex, sdata)) {
+    LogDebug("Skipped a malformed cached TLS session" << Logger::endl);
+    return;
+  }
+
+  CURL *curl = acquire_handle();
+  curl_easy_ssls_import(curl, key.length() > 0 ? key.c_str() : nullptr,
+    (const unsigned char *)shmac.data(), shmac.length(),
+    (const unsigned char *)sdata.data(), sdata.length());
+  release_handle(curl);
+#else
+  (void)line;
+#endif
+}
+
+/* Handle pool */
+
+// options shared by every request. Re-applied after each curl_easy_reset.
+void RawClient::configure_handle(CURL *curl) {
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  if (share_handle) curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
+  if (ca_file.length() > 0) curl_easy_setopt(curl, CURLOPT_CAINFO, ca_file.c_str());
+  {
+    std::lock_guard<std::mutex> guard(resolve_lock);
+    if (resolve_list) curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve_list);
+  }
+  // empty string: offer every encoding this libcurl can decode
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+}
+
+// get a ready-to-use handle, reusing an idle one (and its open connections)
+// whenever possible.
+CURL *RawClient::acquire_handle() {
+  init_transfers();
+  CURL *curl = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(handles_lock);
+    if (!idle_handles.empty()) {
+      curl = idle_handles.back();
+      idle_handles.pop_back();
+    }
+  }
+  if (!curl) {
+    curl = curl_easy_init();
+    if (!curl) {
+      throw HttpException("Error initializing libcurl easy interface");
+    }
+  } else {
+    // clears per-request options, but keeps live connections and caches
+    curl_easy_reset(curl);
+  }
+  configure_handle(curl);
+  return curl;
+}
+
+void RawClient::release_handle(CURL *curl) {
+  {
+    std::lock_guard<std::mutex> guard(handles_lock);
+    if (idle_handles.size() < max_idle_handles) {
+      idle_handles.push_back(curl);
+      return;
+    }
+  }
+  curl_easy_cleanup(curl);
+}
+
+CURLM *RawClient::acquire_multi_handle() {
+  init_transfers();
+  {
+    std::lock_guard<std::mutex> guard(handles_lock);
+    if (!idle_multi_handles.empty()) {
+      CURLM *multi = idle_multi_handles.back();
+      idle_multi_handles.pop_back();
+      return multi;
+    }
+  }
+  CURLM *multi = curl_multi_init();
+  if (!multi) {
+    throw HttpException("Error initializing libcurl multi interface");
+  }
+  return multi;
+}
+
+void RawClient::release_multi_handle(CURLM *multi) {
+  std::lock_guard<std::mutex> guard(handles_lock);
+  idle_multi_handles.push_back(multi);
+}
+
 // set access_token and refresh_token
-void RawClient::set_tokens(std::string at, std::string rt) {
+void RawClient::set_tokens(std::string at, std::string rt, std::time_t expires_at) {
+  std::lock_guard<std::mutex> guard(tokens_lock);
   access_token = at;
   refresh_token = rt;
+  access_token_expires_at = expires_at;
+  tokens_loaded = true;
+}
+
+void RawClient::set_token_loader(bool (*loader)(std::string &at, std::string &rt,
+  std::time_t &expires_at))
+{
+  std::lock_guard<std::mutex> guard(tokens_lock);
+  token_loader = loader;
+  tokens_loaded = false;
+}
+
+void RawClient::set_token_storage_lock(void (*lock)(), void (*unlock)()) {
+  lock_token_storage = lock;
+  unlock_token_storage = unlock;
+}
+
+// a loader that fails leaves the tokens empty, and requests then fail
+// authorization like they would with revoked tokens
+void RawClient::load_tokens_if_needed() {
+  if (tokens_loaded) return;
+  std::lock_guard<std::mutex> guard(tokens_lock);
+  if (tokens_loaded) return;
+  std::string at, rt;
+  std::time_t expires_at = 0;
+  if (token_loader(at, rt, expires_at)) {
+    access_token = at;
+    refresh_token = rt;
+    access_token_expires_at = expires_at;
+  }
+  tokens_loaded = true;
+  LogDebug("[RawClient] tokens loaded on first request" << Logger::endl);
+}
+
+const std::string RawClient::get_access_token() {
+  load_tokens_if_needed();
+  std::lock_guard<std::mutex> guard(tokens_lock);
+  return access_token;
+}
+
+const std::string RawClient::get_refresh_token() {
+  load_tokens_if_needed();
+  std::lock_guard<std::mutex> guard(tokens_lock);
+  return refresh_token;
+}
+
+/* Requests failing authorization at the same time all end up here. Refresh
+ * tokens are rotated on use, so refreshing once per request would have each
+ * refresh invalidate the token the next one uses. Instead the first request
+ * refreshes, and the others wait for it and retry with its result.
+ */
+bool RawClient::refresh_rejected_token(const std::string &rejected_access_token) {
+  std::lock_guard<std::mutex> refreshing(refresh_lock);
+  std::string current_refresh_token;
+  {
+    std::lock_guard<std::mutex> guard(tokens_lock);
+    if (access_token != rejected_access_token) {
+      LogDebug("Token already refreshed by another request" << Logger::endl);
+      return true;
+    }
+    current_refresh_token = refresh_token;
+  }
+  // the refresh failed for a request before this one
+  if (current_refresh_token == rejected_refresh_token) return false;
+
+  // released however this returns
+  struct token_storage_guard {
+    void (*unlock)();
+    ~token_storage_guard() { if (unlock) unlock(); }
+  } storage_guard = {unlock_token_storage};
+  if (lock_token_storage) lock_token_storage();
+
+  std::string stored_at, stored_rt;
+  std::time_t stored_expires_at = 0;
+  if (token_loader && token_loader(stored_at, stored_rt, stored_expires_at) &&
+      stored_at != rejected_access_token) {
+    LogDebug("Using the tokens another process refreshed" << Logger::endl);
+    std::lock_guard<std::mutex> guard(tokens_lock);
+    access_token = stored_at;
+    refresh_token = stored_rt;
+    access_token_expires_at = stored_expires_at;
+    return true;
+  }
+
+  if (perform_token_refresh()) return true;
+  rejected_refresh_token = current_refresh_token;
+  return false;
+}
+
+/* Token expiry */
+
+// tokens expiring within this long are refreshed when nothing waits for it
+const std::time_t refresh_ahead_seconds = 10 * 60;
+// and within this long, before the next request is sent with them, since it
+// would likely be rejected by the time it arrives
+const std::time_t expiry_margin_seconds = 30;
+
+bool RawClient::tokens_expire_soon() {
+  if (!tokens_loaded) return false;
+  std::lock_guard<std::mutex> guard(tokens_lock);
+  return access_token_expires_at != 0 &&
+    std::time(nullptr) + refresh_ahead_seconds >= access_token_expires_at;
+}
+
+void RawClient::refresh_expiring_tokens() {
+  if (!tokens_expire_soon()) return;
+  LogDebug("Access token expires soon, refreshing ahead of time" << Logger::endl);
+  // a failure is left to the next request, which then refreshes itself
+  refresh_rejected_token(get_access_token());
+}
+
+// a failed refresh is remembered by refresh_rejected_token, so the request
+// that follows fails authorization without another attempt
+void RawClient::refresh_if_expired() {
+  load_tokens_if_needed();
+  std::string at;
+  {
+    std::lock_guard<std::mutex> guard(tokens_lock);
+    if (access_token_expires_at == 0 ||
+        std::time(nullptr) + expiry_margin_seconds < access_token_expires_at) {
+      return;
+    }
+    at = access_token;
+  }
+  LogDebug("Access token expired, refreshing before the request" << Logger::endl);
+  refresh_rejected_token(at);
 }
 
 // set the function that should be called when tokens are refreshed
 
+/* Response arenas */
+
+const size_t min_arena_size = 64 * 1024;
+// room for the allocator's bookkeeping at the start of the buffer
+const size_t arena_overhead = 1024;
+
+// empty the document for reuse. If the last document outgrew the buffer, the
+// allocator had to take more memory from the heap, so the buffer is enlarged to
+// fit it from now on.
+void RawClient::response_arena::recycle() {
+  size_t used = allocator ? allocator->Size() : 0;
+  if (allocator && used + arena_overhead <= buffer.size()) {
+    document->SetNull();
+    allocator->Clear();
+    return;
+  }
+
+  document.reset();
+  allocator.reset();
+  size_t size = std::max(buffer.size(), min_arena_size);
+  while (size < used + arena_overhead) size *= 2;
+  buffer.resize(size);
+  allocator.reset(new rapidjson::MemoryPoolAllocator<>(buffer.data(), buffer.size()));
+  document.reset(new rapidjson::Document(allocator.get()));
+}
+
+std::shared_ptr<rapidjson::Document> RawClient::new_response() {
+  std::shared_ptr<RawClient::arena_pool> pool = arenas;
+  RawClient::response_arena *arena = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    if (!pool->idle.empty()) {
+      arena = pool->idle.back().release();
+      pool->idle.pop_back();
+    }
+  }
+  if (!arena) arena = new RawClient::response_arena;
+  arena->recycle();
+
+  // hand the arena back once the document is released
+  return std::shared_ptr<rapidjson::Document>(arena->document.get(),
+    [pool, arena](rapidjson::Document *) {
+      std::lock_guard<std::mutex> guard(pool->lock);
+      pool->idle.emplace_back(arena);
+    });
+}
+
 /* Basic request helper */
 
+void RawClient::request_state::reset() {
+  is_download = false;
+  string_output.clear();
+  body_size = 0;
+  kept_body.clear();
+  etag.clear();
+  last_modified.clear();
+  close_spill_file();
+  if (splitter) splitter->reset();
+  stream_error = nullptr;
+  if (response) response->SetNull();
+  status = ResponseOk;
+}
+
+void RawClient::request_state::close_spill_file() {
+  if (spill_fd >= 0) close(spill_fd);
+  spill_fd = -1;
+}
+
+/* spilling large bodies to disk */
+
+// moves the body received so far into a new temporary file. The file is
+// unlinked right away, so it disappears once it is closed, even if the process
+// is killed.
+static bool spill_to_file(RawClient::request_state *rstate) {
+  const char *tmpdir = getenv("TMPDIR");
+  std::string path = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp")
+    + "/autolab-response-XXXXXX";
+  std::vector<char> path_buffer(path.begin(), path.end());
+  path_buffer.push_back('\0');
+
+  int fd = mkstemp(path_buffer.data());
+  if (fd < 0) return false;
+  unlink(path_buffer.data());
+  rstate->spill_fd = fd;
+  LogDebug("Spilling response body to disk after " << rstate->string_output.length()
+    << " bytes" << Logger::endl);
+
+  if (!write_fully(fd, rstate->string_output.data(), rstate->string_output.length())) {
+    return false;
+  }
+  // release the memory, not just the contents
+  std::string().swap(rstate->string_output);
+  return true;
+}
+
+
+// if the header line is the named header, stores its value and returns true.
+// Header names are case-insensitive.
+static bool read_header(const char *data, size_t length, const char *name, std::string &value) {
+  size_t name_length = std::strlen(name);
+  if (length <= name_length || data[name_length] != ':' ||
+      strncasecmp(data, name, name_length) != 0) {
+    return false;
+  }
+  size_t start = name_length + 1;
+  size_t end = length;
+  while (start < end && (data[start] == ' ' || data[start] == '\t')) start++;
+  while (end > start && std::strchr(" \t\r\n", data[end - 1])) end--;
+  value.assign(data + start, end - start);
+  return true;
+}
 
 // libcurl header callback function
 size_t header_callback(char *data, size_t size, size_t nmemb, 
                   RawClient::request_state *rstate) {
   if (!data) return 0;
 
+  // validators, for conditional requests later on. A status line starts the
+  // headers of a new response (after a redirect, or 100 Continue).
+  size_t length = size*nmemb;
+  if (length >= 5 && std::strncmp(data, "HTTP/", 5) == 0) {
+    rstate->etag.clear();
+    rstate->last_modified.clear();
+  } else if (!read_header(data, length, "ETag", rstate->etag)) {
+    read_header(data, length, "Last-Modified", rstate->last_modified);
+  }
+
   if (rstate->consider_download()) {
     // find out if this is supposed to be a download
     // and if so, find out the filename
@@ -81,15 +730,54 @@ size_t header_callback(char *data, size_t size, size_t nmemb,
   return size*nmemb;
 }
 
+// streamed bodies are otherwise not kept, a copy is needed to cache them.
+// Bodies too large to keep in memory are not cached.
+static void keep_body_for_cache(RawClient::request_state *rstate, const char *data, size_t length) {
+  if (rstate->cache_key.empty()) return;
+  if (rstate->spill_threshold > 0 &&
+      rstate->kept_body.length() + length > rstate->spill_threshold) {
+    rstate->cache_key.clear();
+    std::string().swap(rstate->kept_body);
+    return;
+  }
+  rstate->kept_body.append(data, length);
+}
+
 // libcurl write callback function
 static size_t write_callback(char *data, size_t size, size_t nmemb,
                   RawClient::request_state *rstate) {
   if (!data) return 0;
 
+  rstate->body_size += size*nmemb;
   if (rstate->is_download) {
     rstate->file_output.write(data, size*nmemb);
+  } else if (rstate->splitter) {
+    // exceptions must not unwind through libcurl, keep it for later and
+    // abort the transfer instead
+    keep_body_for_cache(rstate, data, size*nmemb);
+    try {
+      rstate->splitter->feed(data, size*nmemb);
+    } catch (...) {
+      rstate->stream_error = std::current_exception();
+      return 0;
+    }
   } else {
-    rstate->string_output.append(data, size*nmemb);
+    size_t length = size*nmemb;
+    if (rstate->spill_fd < 0 && rstate->spill_threshold > 0 &&
+        rstate->string_output.length() + length > rstate->spill_threshold) {
+      if (!spill_to_file(rstate)) {
+        rstate->stream_error = std::make_exception_ptr(
+          HttpException("Error writing response to a temporary file"));
+        return 0;
+      }
+    }
+    if (rstate->spill_fd < 0) {
+      rstate->string_output.append(data, length);
+    } else if (!write_fully(rstate->spill_fd, data, length)) {
+      rstate->stream_error = std::make_exception_ptr(
+        HttpException("Error writing response to a temporary file"));
+      return 0;
+    }
   }
 
   return size*nmemb;
@@ -130,42 +818,42 @@ void RawClient::free_params(RawClient::param_list &params) {
   }
 }
 
-/* actually perform the HTTP request using libcurl.
+/* configure a curl handle to perform the request. Output of the request will be
+ * written into rstate.
  */
-long RawClient::raw_request(RawClient::request_state *rstate,
+void RawClient::setup_request(CURL *curl, RawClient::request_state *rstate,
   RawClient::path_segments &path, RawClient::param_list &params,
-  RawClient::HttpMethod method = GET)
+  RawClient::HttpMethod method)
 {
-  CURL *curl;
-  CURLcode res;
-  struct curl_httppost *formpost = nullptr;
   struct curl_httppost *lastptr = nullptr;
 
-  curl = curl_easy_init();
-  if (!curl) {
-    throw HttpException("Error initializing libcurl easy interface");
-  }
+  // the tokens were loaded by the caller, before it took the handle
+  update_access_token_in_params(params);
 
   std::string full_path = construct_path(curl, base_uri, path);
   std::string param_str = construct_params(curl, params);
+  free_params(params);
+  free_path(path);
 
   LogDebug("Requesting " << full_path << " with params " << param_str << Logger::endl
     << Logger::endl);
+  rstate->spill_threshold = spill_threshold;
   
   if (method == POST) {
     if (rstate->file_upload) {
       // setup form
-      curl_formadd(&formpost,
+      curl_formadd(&rstate->formpost,
                    &lastptr,
                    CURLFORM_COPYNAME, "submission[file]",
                    CURLFORM_FILE, rstate->upload_filename.c_str(),
                    CURLFORM_END);
       // insert form
-      curl_easy_setopt(curl, CURLOPT_HTTPPOST, formpost);
+      curl_easy_setopt(curl, CURLOPT_HTTPPOST, rstate->formpost);
       // add params
       full_path.append("?" + param_str);
     } else {
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, param_str.c_str());
+      // param_str goes out of scope before the transfer, so let curl copy it
+      curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, param_str.c_str());
     }
   } else {
     full_path.append("?" + param_str);
@@ -181,64 +869,273 @@ long RawClient::raw_request(RawClient::request_state *rstate,
 
   curl_easy_setopt(curl, CURLOPT_URL, full_path.c_str());
 
+  if (rstate->if_none_match.length() > 0) {
+    rstate->headers = curl_slist_append(rstate->headers,
+      ("If-None-Match: " + rstate->if_none_match).c_str());
+  }
+  if (rstate->if_modified_since.length() > 0) {
+    rstate->headers = curl_slist_append(rstate->headers,
+      ("If-Modified-Since: " + rstate->if_modified_since).c_str());
+  }
+  if (rstate->headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, rstate->headers);
+
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, rstate);
   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
   curl_easy_setopt(curl, CURLOPT_HEADERDATA, rstate);
+}
+
+/* collect the results of a finished transfer, free its resources and return
+ * the handle to the pool.
+ */
+long RawClient::finish_request(CURL *curl, RawClient::request_state *rstate) {
+  long response_code = 0;
+  long new_connections = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+  rstate->response_code = response_code;
+  if (response_code > 0) remember_resolved_address(curl);
+
+  // bytes on the wire, before content decoding
+  curl_off_t bytes_received = 0;
+  curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes_received);
+  num_bytes_received += bytes_received;
+  num_bytes_decoded += rstate->body_size;
+#ifdef PRINT_DEBUG
+  char *url = nullptr;
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  std::string endpoint(url ? url : "");
+  endpoint = endpoint.substr(0, endpoint.find('?')); // leave out the token
+  LogDebug("Received " << (long long)bytes_received << " bytes ("
+    << rstate->body_size << " decoded) from " << endpoint << Logger::endl);
+#endif
+
+  num_transfers++;
+  num_new_connections += new_connections;
+  if (new_connections == 0) num_reused_connections++;
+  LogDebug("New connections made: " << new_connections
+    << " (reused connections so far: " << num_reused_connections.load()
+    << "/" << num_transfers.load() << ")" << Logger::endl);
+
+  rstate->free_form();
+  rstate->free_headers();
+  release_handle(curl);
+
+  if (response_code == 304 && rstate->is_conditional()) {
+    serve_not_modified(rstate);
+  } else {
+    parse_body(rstate);
+  }
 
-  res = curl_easy_perform(curl);
+  return rstate->response_code;
+}
+
+/* actually perform the HTTP request using libcurl.
+ */
+long RawClient::raw_request(RawClient::request_state *rstate,
+  RawClient::path_segments &path, RawClient::param_list &params,
+  RawClient::HttpMethod method = GET)
+{
+  // only now that the request goes out are the tokens needed. The loader may
+  // throw, so this comes before a handle is taken.
+  load_tokens_if_needed();
+
+  // returned to the pool if the request can't be set up
+  struct handle_guard {
+    RawClient *client;
+    RawClient::request_state *rstate;
+    CURL *handle;
+    ~handle_guard() {
+      if (!handle) return;
+      rstate->free_form();
+      rstate->free_headers();
+      client->release_handle(handle);
+    }
+  } guard = {this, rstate, acquire_handle()};
+  setup_request(guard.handle, rstate, path, params, method);
+
+  CURLcode res = curl_easy_perform(guard.handle);
+  CURL *curl = guard.handle;
+  guard.handle = nullptr; // finish_request returns it
+  long response_code = finish_request(curl, rstate);
+
+  if (rstate->stream_error) std::rethrow_exception(rstate->stream_error);
   if (res != CURLE_OK) {
+    if (res == CURLE_COULDNT_CONNECT) forget_resolved_address();
     throw HttpException(curl_easy_strerror(res));
   }
 
-  long response_code;
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-  rstate->response_code = response_code;
+  return response_code;
+}
 
-  // free resources
-  free_params(params);
-  free_path(path);
-  if (formpost) curl_formfree(formpost);
+/* perform all the given requests concurrently on the multi handle, and return
+ * once every one of them has completed.
+ */
+void RawClient::raw_request_concurrently(std::vector<RawClient::batch_request *> &requests) {
+  // may throw, so before any handle is taken
+  load_tokens_if_needed();
+
+  // returned to the pool however this returns
+  struct multi_handle_guard {
+    RawClient *client;
+    CURLM *handle;
+    ~multi_handle_guard() { client->release_multi_handle(handle); }
+  } guard = {this, acquire_multi_handle()};
+  CURLM *multi_handle = guard.handle;
+
+  // On the way out, transfers that weren't finished are taken off the multi
+  // handle before it goes back to the pool. Otherwise the next batch would
+  // drive them, writing into request states that are gone by then.
+  struct transfers_guard {
+    RawClient *client;
+    CURLM *multi_handle;
+    std::vector<RawClient::batch_request *> &requests;
+    ~transfers_guard() {
+      for (auto req : requests) {
+        if (!req->curl) continue;
+        curl_multi_remove_handle(multi_handle, req->curl);
+        req->rstate.free_form();
+        req->rstate.free_headers();
+        client->release_handle(req->curl);
+        req->curl = nullptr;
+      }
+    }
+  } transfers = {this, multi_handle, requests};
 
-  curl_easy_cleanup(curl);
+  for (auto req : requests) {
+    req->curl = acquire_handle();
+    setup_request(req->curl, &req->rstate, req->path, req->params, req->method);
+    curl_easy_setopt(req->curl, CURLOPT_PRIVATE, req);
+    curl_multi_add_handle(multi_handle, req->curl);
+  }
 
-  return response_code;
+  int still_running = 0;
+  do {
+    CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
+    if (mc == CURLM_OK && still_running) {
+      mc = curl_multi_wait(multi_handle, nullptr, 0, 1000, nullptr);
+    }
+    if (mc != CURLM_OK) {
+      // give up on all requests that haven't finished yet
+      for (auto req : requests) {
+        if (!req->curl) continue;
+        curl_multi_remove_handle(multi_handle, req->curl);
+        finish_request(req->curl, &req->rstate);
+        req->curl = nullptr;
+      }
+      throw HttpException(curl_multi_strerror(mc));
+    }
+
+    // collect finished transfers
+    CURLMsg *msg;
+    int msgs_left;
+    while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
+      if (msg->msg != CURLMSG_DONE) continue;
+      RawClient::batch_request *req = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &req);
+      req->result = msg->data.result;
+      curl_multi_remove_handle(multi_handle, req->curl);
+      finish_request(req->curl, &req->rstate);
+      req->curl = nullptr;
+    }
+  } while (still_running);
 }
 
-bool RawClient::document_has_error(RawClient::request_state *rstate, 
-  const std::string &error_msg)
-{
-  if (rstate->is_download) return false;
-  rapidjson::Document response;
-  response.Parse(rstate->string_output.c_str());
-  return response.IsObject() &&
-         response.HasMember("error") &&
-         response["error"].IsString() &&
-         response["error"].GetString() == error_msg;
-  return false;
+/* parse the body of a finished transfer into rstate->response and classify
+ * it, so that checking for errors later doesn't have to parse it again.
+ */
+const std::string oauth_auth_failed_response = "OAuth2 authorization failed";
+void RawClient::parse_body(RawClient::request_state *rstate) {
+  rstate->close_file_output();
+  rstate->status = RawClient::ResponseOk;
+  if (rstate->is_download) return;
+
+  if (rstate->splitter && rstate->splitter->is_array()) {
+    // the elements have already been handed out while streaming. Unless the
+    // array ended properly, they may be only some of them, and the body is
+    // neither used nor cached.
+    if (!rstate->splitter->complete()) {
+      rstate->status = RawClient::ResponseError;
+      if (!rstate->stream_error) {
+        rstate->stream_error = std::make_exception_ptr(
+          InvalidResponseException("Incomplete or malformed list in the response"));
+      }
+      return;
+    }
+    rstate->response->SetArray();
+    return;
+  }
+  rapidjson::Document &doc = *rstate->response;
+  if (rstate->spill_fd >= 0) {
+    parse_spilled_body(rstate);
+  } else {
+    LogDebug(rstate->string_output << Logger::endl);
+    // parse in place from a copy of the body kept in the document's own pool,
+    // so strings are referenced instead of copied one by one.
+    size_t length = rstate->string_output.length();
+    char *body = static_cast<char *>(doc.GetAllocator().Malloc(length + 1));
+    std::memcpy(body, rstate->string_output.c_str(), length + 1);
+    doc.ParseInsitu(body);
+  }
+
+  if (!doc.IsObject()) return;
+  rapidjson::Value::MemberIterator error_it = doc.FindMember("error");
+  if (error_it != doc.MemberEnd()) {
+    rapidjson::Value &error = error_it->value;
+    if (error.IsString() && error.GetString() == oauth_auth_failed_response) {
+      rstate->status = RawClient::ResponseAuthFailed;
+    } else {
+      rstate->status = RawClient::ResponseError;
+    }
+  }
+}
+
+/* parse a body that was spilled to disk. The file is mapped read-only and
+ * parsed without modifying it, so its pages stay clean and the kernel can drop
+ * them again at any time, instead of holding a second copy of the body in
+ * memory.
+ */
+void RawClient::parse_spilled_body(RawClient::request_state *rstate) {
+  rapidjson::Document &doc = *rstate->response;
+  size_t length = rstate->body_size;
+  LogDebug("(" << length << " bytes, parsed from disk)" << Logger::endl);
+
+  void *body = length > 0 ?
+    mmap(nullptr, length, PROT_READ, MAP_PRIVATE, rstate->spill_fd, 0) : MAP_FAILED;
+  if (body == MAP_FAILED) {
+    rstate->close_spill_file();
+    doc.SetNull();
+    rstate->stream_error = std::make_exception_ptr(
+      HttpException("Error mapping the response from a temporary file"));
+    return;
+  }
+  madvise(body, length, MADV_SEQUENTIAL);
+  doc.Parse(static_cast<const char *>(body), length);
+  munmap(body, length);
+  rstate->close_spill_file();
 }
 
 /* performs raw_request, and if error is authorization_failed, refresh tokens
  * and try again.
  */
-const std::string oauth_auth_failed_response = "OAuth2 authorization failed";
 long RawClient::raw_request_optional_refresh(
   RawClient::request_state *rstate, 
   RawClient::path_segments &path, RawClient::param_list &params, 
   RawClient::HttpMethod method = GET, bool refresh = true)
 {
+  if (refresh) refresh_if_expired();
   long rc = raw_request(rstate, path, params, method);
   if (!refresh) return rc;
 
-  if (rc == 200 || !document_has_error(rstate, oauth_auth_failed_response)) {
+  if (rc == 200 || rstate->status != RawClient::ResponseAuthFailed) {
     return rc;
   }
 
-  if (perform_token_refresh()) {
+  if (refresh_rejected_token(access_token_in_params(params))) {
     rstate->reset();
     update_access_token_in_params(params);
     rc = raw_request(rstate, path, params, method);
-    if (rc == 200 || !document_has_error(rstate, oauth_auth_failed_response)) {
+    if (rc == 200 || rstate->status != RawClient::ResponseAuthFailed) {
       // all good now
       LogDebug("Successfully refreshed token" << Logger::endl);
       return rc;
@@ -248,6 +1145,15 @@ long RawClient::raw_request_optional_refresh(
   throw InvalidTokenException();
 }
 
+// ask the server to answer 304 Not Modified instead of sending the body
+// again, if the cached response is still current.
+static void make_conditional(RawClient::request_state *rstate, cached_response *cached) {
+  if (!cached || (cached->etag.empty() && cached->last_modified.empty())) return;
+  rstate->if_none_match = cached->etag;
+  rstate->if_modified_since = cached->last_modified;
+  rstate->cached_body.swap(cached->body);
+}
+
 /* make a HTTP request
  *
  * params:
@@ -268,25 +1174,299 @@ long RawClient::make_request(rapidjson::Document &response,
   RawClient::HttpMethod method = GET, bool refresh = true,
   const std::string &download_dir = "",
   const std::string &suggested_filename = "",
-  const std::string &upload_filename = "")
+  const std::string &upload_filename = "",
+  const RawClient::ElementCallback &element_cb = RawClient::ElementCallback(),
+  const std::string &cache_key = "", cached_response *cached = nullptr)
 {
-  RawClient::request_state rstate(download_dir, suggested_filename);
+  RawClient::batch_request_queue *batch = current_batch();
+  if (batch && upload_filename.length() == 0) {
+    // queue up, the request is performed later in perform_batch
+    batch->emplace_back(new batch_request(response, path, params, method,
+      refresh, download_dir, suggested_filename));
+    batch->back()->rstate.cache_key = cache_key;
+    make_conditional(&batch->back()->rstate, cached);
+    stream_elements(&batch->back()->rstate, element_cb);
+    return 0;
+  }
+
+  RawClient::request_state rstate(response, download_dir, suggested_filename);
   if (upload_filename.length() > 0) {
     rstate.upload_filename = upload_filename;
     rstate.file_upload = true;
   }
+  rstate.cache_key = cache_key;
+  make_conditional(&rstate, cached);
+  stream_elements(&rstate, element_cb);
 
   long rc = raw_request_optional_refresh(&rstate, path, params, method, refresh);
+  store_response(&rstate);
 
   LogDebug("Completed make request" << Logger::endl);
 
-  rstate.close_file_output();
-  if (!rstate.is_download) {
-    LogDebug(rstate.string_output << Logger::endl);
-    response.Parse(rstate.string_output.c_str());
+  return rc;
+}
+
+void RawClient::stream_elements(RawClient::request_state *rstate,
+  const RawClient::ElementCallback &element_cb)
+{
+  if (!element_cb) return;
+  rstate->splitter.reset(new json_array_splitter(element_cb, rstate->string_output));
+}
+
+/* Batching */
+
+void RawClient::begin_batch() {
+  std::lock_guard<std::mutex> guard(batches_lock);
+  batches[std::this_thread::get_id()];
+}
+
+bool RawClient::is_batching() {
+  return current_batch() != nullptr;
+}
+
+// the queue stays where it is while other threads add theirs, and only the
+// thread it belongs to uses it
+RawClient::batch_request_queue *RawClient::current_batch() {
+  std::lock_guard<std::mutex> guard(batches_lock);
+  auto it = batches.find(std::this_thread::get_id());
+  return it == batches.end() ? nullptr : &it->second;
+}
+
+/* perform all requests queued since begin_batch concurrently. Requests that
+ * fail authorization are retried together after a single token refresh.
+ * Throws after all requests have completed if any of them failed.
+ */
+void RawClient::perform_batch() {
+  RawClient::batch_request_queue queue;
+  {
+    std::lock_guard<std::mutex> guard(batches_lock);
+    auto it = batches.find(std::this_thread::get_id());
+    if (it == batches.end()) return;
+    queue.swap(it->second);
+    batches.erase(it);
   }
+  if (queue.empty()) return;
 
-  return rc;
+  std::vector<batch_request *> requests;
+  for (auto &req : queue) {
+    if (req->from_cache) {
+      serve_cached_or_invalidate(&req->rstate, req->rstate.kept_body);
+    } else {
+      requests.push_back(req.get());
+    }
+  }
+  if (requests.empty()) return;
+  LogDebug("Performing batch of " << requests.size() << " requests" << Logger::endl);
+  refresh_if_expired();
+  raw_request_concurrently(requests);
+
+  for (auto req : requests) {
+    if (req->rstate.stream_error) std::rethrow_exception(req->rstate.stream_error);
+    if (req->result != CURLE_OK) {
+      if (req->result == CURLE_COULDNT_CONNECT) forget_resolved_address();
+      throw HttpException(curl_easy_strerror(req->result));
+    }
+  }
+
+  // retry requests that failed authorization with a refreshed token
+  std::vector<batch_request *> failed;
+  for (auto req : requests) {
+    if (req->refresh && req->rstate.response_code != 200 &&
+        req->rstate.status == RawClient::ResponseAuthFailed) {
+      failed.push_back(req);
+    }
+  }
+  if (failed.size() > 0) {
+    // the first refreshes, the others find the token already replaced
+    for (auto req : failed) {
+      if (!refresh_rejected_token(access_token_in_params(req->params))) {
+        throw InvalidTokenException();
+      }
+    }
+
+    for (auto req : failed) {
+      req->rstate.reset();
+      update_access_token_in_params(req->params);
+    }
+    raw_request_concurrently(failed);
+
+    for (auto req : failed) {
+      if (req->rstate.stream_error) std::rethrow_exception(req->rstate.stream_error);
+      if (req->result != CURLE_OK) {
+        throw HttpException(curl_easy_strerror(req->result));
+      }
+      if (req->rstate.response_code != 200 &&
+          req->rstate.status == RawClient::ResponseAuthFailed) {
+        throw InvalidTokenException();
+      }
+    }
+    LogDebug("Successfully refreshed token" << Logger::endl);
+  }
+
+  for (auto req : requests) {
+    store_response(&req->rstate);
+  }
+}
+
+/* Response cache */
+
+void RawClient::enable_response_cache(const std::string &dir) {
+  cache.reset(new response_cache(dir));
+}
+
+// identifies a read by its url, without the access token
+std::string RawClient::cache_key(const RawClient::path_segments &path,
+  const RawClient::param_list &params)
+{
+  std::string key(base_uri);
+  for (auto &segment : path) {
+    key.append("/" + segment.value);
+  }
+  key.append("?");
+  for (auto &param : params) {
+    if (param.key == "access_token") continue;
+    key.append(param.key + "=" + param.value + "&");
+  }
+  return key;
+}
+
+/* perform a read, unless it can be answered from the response cache. Reads of
+ * stale responses are remembered for revalidate_stale_responses.
+ */
+long RawClient::make_cached_request(rapidjson::Document &response,
+  RawClient::CachedResource resource, RawClient::path_segments &path,
+  RawClient::param_list &params, const RawClient::ElementCallback &element_cb)
+{
+  if (!cache) {
+    return make_request(response, path, params, GET, true, "", "", "", element_cb);
+  }
+
+  std::string key = cache_key(path, params);
+  cached_response entry;
+  bool cached = cache->load(key, entry);
+  if (cached && !cache_bypass) {
+    std::time_t age = std::time(nullptr) - entry.fetched_at;
+    const RawClient::CachePolicy &policy = cache_policies[resource];
+    if (age >= 0 && age <= policy.ttl + policy.max_stale) {
+      LogDebug("[Cache] serving " << key << " (" << (long long)age << "s old)" << Logger::endl);
+      if (age > policy.ttl) {
+        std::lock_guard<std::mutex> guard(stale_lock);
+        bool queued = false;
+        for (auto &req : stale_requests) {
+          if (req.key == key) queued = true;
+        }
+        if (!queued) stale_requests.push_back({key, path, params});
+      }
+
+      RawClient::batch_request_queue *batch = current_batch();
+      if (batch) {
+        // served by perform_batch, like the other queued requests
+        batch->emplace_back(new batch_request(response, path, params, GET,
+          true, "", ""));
+        batch_request &req = *batch->back();
+        req.from_cache = true;
+        req.rstate.cache_key = key;
+        req.rstate.kept_body.swap(entry.body);
+        stream_elements(&req.rstate, element_cb);
+        return 0;
+      }
+      RawClient::request_state rstate(response, "", "");
+      rstate.cache_key = key;
+      stream_elements(&rstate, element_cb);
+      serve_cached_or_invalidate(&rstate, entry.body);
+      return 200;
+    }
+  }
+
+  // if the server still has the same response, it doesn't have to send it
+  return make_request(response, path, params, GET, true, "", "", "", element_cb,
+    key, cached ? &entry : nullptr);
+}
+
+// handle a cached body as if it had just been received
+void RawClient::serve_cached(RawClient::request_state *rstate, std::string &body) {
+  rstate->response_code = 200;
+  rstate->body_size = body.length();
+  if (rstate->splitter) {
+    rstate->splitter->feed(body.data(), body.length());
+  } else {
+    rstate->string_output.swap(body);
+  }
+  parse_body(rstate);
+  if (rstate->stream_error) std::rethrow_exception(rstate->stream_error);
+}
+
+// a cached body that can't be served (e.g. a list cut off by an older version
+// that cached it anyway) is dropped, so the next read fetches it again
+void RawClient::serve_cached_or_invalidate(RawClient::request_state *rstate,
+  std::string &body)
+{
+  try {
+    serve_cached(rstate, body);
+  } catch (InvalidResponseException &) {
+    LogDebug("[Cache] dropping unusable " << rstate->cache_key << Logger::endl);
+    cache->invalidate(rstate->cache_key);
+    throw;
+  }
+}
+
+// the answer to a conditional request was 304 Not Modified, so the cached
+// response is still current. It is stored again to renew its fetch time.
+void RawClient::serve_not_modified(RawClient::request_state *rstate) {
+  LogDebug("[Cache] not modified: " << rstate->cache_key << Logger::endl);
+  if (rstate->etag.empty()) rstate->etag = rstate->if_none_match;
+  if (rstate->last_modified.empty()) rstate->last_modified = rstate->if_modified_since;
+  if (rstate->splitter) rstate->kept_body = rstate->cached_body;
+
+  // called while transfers are running, so errors are kept for later
+  try {
+    serve_cached(rstate, rstate->cached_body);
+  } catch (...) {
+    rstate->stream_error = std::current_exception();
+  }
+}
+
+void RawClient::store_response(RawClient::request_state *rstate) {
+  if (!cache || rstate->cache_key.empty()) return;
+  if (rstate->response_code != 200 || rstate->status != RawClient::ResponseOk) return;
+
+  bool streamed = rstate->splitter && rstate->splitter->is_array();
+  const std::string &body = streamed ? rstate->kept_body : rstate->string_output;
+  // spilled bodies are not kept in memory
+  if (body.length() != rstate->body_size) return;
+  cache->store(rstate->cache_key, body, rstate->etag, rstate->last_modified);
+}
+
+void RawClient::invalidate_cached(const RawClient::path_segments &path) {
+  if (!cache) return;
+  cache->invalidate(cache_key(path, RawClient::param_list()));
+}
+
+bool RawClient::has_stale_responses() {
+  std::lock_guard<std::mutex> guard(stale_lock);
+  return !stale_requests.empty();
+}
+
+void RawClient::revalidate_stale_responses() {
+  std::vector<RawClient::stale_request> pending;
+  {
+    std::lock_guard<std::mutex> guard(stale_lock);
+    pending.swap(stale_requests);
+  }
+  if (pending.empty()) return;
+
+  LogDebug("[Cache] revalidating " << pending.size() << " responses" << Logger::endl);
+  std::vector<std::shared_ptr<rapidjson::Document>> responses;
+  begin_batch();
+  for (auto &req : pending) {
+    responses.push_back(new_response());
+    update_access_token_in_params(req.params);
+    cached_response entry;
+    bool cached = cache->load(req.key, entry);
+    make_request(*responses.back(), req.path, req.params, GET, true, "", "", "",
+      RawClient::ElementCallback(), req.key, cached ? &entry : nullptr);
+  }
+  perform_batch();
 }
 
 /* Authorization (device-flow) & Authentication */
@@ -370,10 +1550,34 @@ int RawClient::device_flow_authorize(size_t timeout) {
 bool RawClient::save_tokens_from_response(rapidjson::Document &response) {
   if (response.HasMember("access_token") && response.HasMember("refresh_token")) {
     // looks good
-    access_token = response["access_token"].GetString();
-    refresh_token = response["refresh_token"].GetString();
-    if (new_tokens_callback) {
-      new_tokens_callback(access_token, refresh_token);
+    std::string at = response["access_token"].GetString();
+    std::string rt = response["refresh_token"].GetString();
+
+    // Counted from created_at when the server says when it issued the token,
+    // unless that is later than our own clock, in which case the token is
+    // treated as issued now, so a server clock ahead of ours doesn't make
+    // the token seem to last longer.
+    std::time_t expires_at = 0;
+    if (response.HasMember("expires_in") && response["expires_in"].IsInt64()) {
+      std::time_t issued_at = std::time(nullptr);
+      if (response.HasMember("created_at") && response["created_at"].IsInt64() &&
+          response["created_at"].GetInt64() < issued_at) {
+        issued_at = response["created_at"].GetInt64();
+      }
+      expires_at = issued_at + response["expires_in"].GetInt64();
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(tokens_lock);
+      access_token = at;
+      refresh_token = rt;
+      access_token_expires_at = expires_at;
+      tokens_loaded = true; // newer than any the loader would find
+    }
+    if (new_expiring_tokens_callback) {
+      new_expiring_tokens_callback(at, rt, expires_at);
+    } else if (new_tokens_callback) {
+      new_tokens_callback(at, rt);
     }
     return true;
   }
@@ -405,7 +1609,7 @@ bool RawClient::perform_token_refresh() {
   params.emplace_back("grant_type", "refresh_token");
   params.emplace_back("client_id", client_id);
   params.emplace_back("client_secret", client_secret);
-  params.emplace_back("refresh_token", refresh_token);
+  params.emplace_back("refresh_token", get_refresh_token());
 
   rapidjson::Document response;
   make_request(response, path, params, POST, false);
@@ -422,10 +1626,31 @@ void RawClient::init_regular_path(RawClient::path_segments &path) {
 
 void RawClient::init_regular_params(RawClient::param_list &params) {
   params.clear();
-  params.emplace_back("access_token", access_token);
+  // filled in by setup_request, with the token current when it is sent
+  params.emplace_back("access_token", "");
 }
 
 // common paths
+void RawClient::init_submissions_path(RawClient::path_segments &path,
+  const std::string &course_name, const std::string &asmt_name)
+{
+  init_regular_path(path);
+  path.emplace_back("courses");
+  path.emplace_back(course_name);
+  path.emplace_back("assessments");
+  path.emplace_back(asmt_name);
+  path.emplace_back("submissions");
+}
+
+void RawClient::init_enrollments_path(RawClient::path_segments &path,
+  const std::string &course_name)
+{
+  init_regular_path(path);
+  path.emplace_back("courses");
+  path.emplace_back(course_name);
+  path.emplace_back("course_user_data");
+}
+
 void RawClient::init_oauth_token_path(RawClient::path_segments &path) {
   path.clear();
   path.emplace_back("oauth");
@@ -447,12 +1672,21 @@ void RawClient::init_device_flow_authorize_path(RawClient::path_segments &path)
 void RawClient::update_access_token_in_params(RawClient::param_list &params) {
   for (auto &param : params) {
     if (param.key == "access_token") {
+      std::lock_guard<std::mutex> guard(tokens_lock);
       param.value = access_token;
       break;
     }
   }
 }
 
+// the access token a request was sent with
+std::string RawClient::access_token_in_params(const RawClient::param_list &params) {
+  for (auto &param : params) {
+    if (param.key == "access_token") return param.value;
+  }
+  return "";
+}
+
 RawClient::HttpMethod RawClient::crud_to_http(CrudAction action) {
   HttpMethod method = HttpMethod::GET;
   switch (action) {
@@ -480,7 +1714,7 @@ void RawClient::get_user_info(rapidjson::Document &result) {
   RawClient::param_list params;
   init_regular_params(params);
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheUserInfo, path, params, ElementCallback());
 }
 
 void RawClient::get_courses(rapidjson::Document &result) {
@@ -492,7 +1726,7 @@ void RawClient::get_courses(rapidjson::Document &result) {
   init_regular_params(params);
   params.emplace_back("state", "current");
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheCourses, path, params, ElementCallback());
 }
 
 void RawClient::get_assessments(rapidjson::Document &result, const std::string &course_name) {
@@ -505,7 +1739,7 @@ void RawClient::get_assessments(rapidjson::Document &result, const std::string &
   RawClient::param_list params;
   init_regular_params(params);
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheAssessments, path, params, ElementCallback());
 }
 
 void RawClient::get_assessment_details(rapidjson::Document &result, const std::string &course_name, const std::string &asmt_name) {
@@ -519,7 +1753,7 @@ void RawClient::get_assessment_details(rapidjson::Document &result, const std::s
   RawClient::param_list params;
   init_regular_params(params);
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheAssessmentDetails, path, params, ElementCallback());
 }
 
 void RawClient::get_problems(rapidjson::Document &result, const std::string &course_name, const std::string &asmt_name) {
@@ -534,7 +1768,7 @@ void RawClient::get_problems(rapidjson::Document &result, const std::string &cou
   RawClient::param_list params;
   init_regular_params(params);
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheProblems, path, params, ElementCallback());
 }
 
 void RawClient::download_handout(rapidjson::Document &result, std::string download_dir, const std::string &course_name, const std::string &asmt_name) {
@@ -580,21 +1814,24 @@ void RawClient::submit_assessment(rapidjson::Document &result, const std::string
   init_regular_params(params);
 
   make_request(result, path, params, POST, true, "", "", filename);
+
+  // the new submission makes the cached list outdated
+  init_submissions_path(path, course_name, asmt_name);
+  invalidate_cached(path);
 }
 
 void RawClient::get_submissions(rapidjson::Document &result, const std::string &course_name, const std::string &asmt_name) {
+  get_submissions(result, RawClient::ElementCallback(), course_name, asmt_name);
+}
+
+void RawClient::get_submissions(rapidjson::Document &result, RawClient::ElementCallback element_cb, const std::string &course_name, const std::string &asmt_name) {
   RawClient::path_segments path;
-  init_regular_path(path);
-  path.emplace_back("courses");
-  path.emplace_back(course_name);
-  path.emplace_back("assessments");
-  path.emplace_back(asmt_name);
-  path.emplace_back("submissions");
+  init_submissions_path(path, course_name, asmt_name);
 
   RawClient::param_list params;
   init_regular_params(params);
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheSubmissions, path, params, element_cb);
 }
 
 void RawClient::get_feedback(rapidjson::Document &result, const std::string &course_name, const std::string &asmt_name, int sub_version, const std::string &problem_name) {
@@ -612,28 +1849,26 @@ void RawClient::get_feedback(rapidjson::Document &result, const std::string &cou
   init_regular_params(params);
   params.emplace_back("problem", problem_name);
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheFeedback, path, params, ElementCallback());
 }
 
 void RawClient::get_enrollments(rapidjson::Document &result, const std::string &course_name) {
+  get_enrollments(result, RawClient::ElementCallback(), course_name);
+}
+
+void RawClient::get_enrollments(rapidjson::Document &result, RawClient::ElementCallback element_cb, const std::string &course_name) {
   RawClient::path_segments path;
-  init_regular_path(path);
-  path.emplace_back("courses");
-  path.emplace_back(course_name);
-  path.emplace_back("course_user_data");
+  init_enrollments_path(path, course_name);
 
   RawClient::param_list params;
   init_regular_params(params);
 
-  make_request(result, path, params);
+  make_cached_request(result, CacheEnrollments, path, params, element_cb);
 }
 
 void RawClient::crud_enrollment(rapidjson::Document &result, const std::string &course_name, std::string email, RawClient::Params &in_params, CrudAction action) {
   RawClient::path_segments path;
-  init_regular_path(path);
-  path.emplace_back("courses");
-  path.emplace_back(course_name);
-  path.emplace_back("course_user_data");
+  init_enrollments_path(path, course_name);
   if (action != Create) path.emplace_back(email);
 
   RawClient::param_list params;
@@ -646,6 +1881,11 @@ void RawClient::crud_enrollment(rapidjson::Document &result, const std::string &
   HttpMethod method = crud_to_http(action);
 
   make_request(result, path, params, method);
+
+  if (action != Read) {
+    init_enrollments_path(path, course_name);
+    invalidate_cached(path);
+  }
 }
 
 } /* namespace Autolab */
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "response_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>    // open
+#include <stdio.h>    // rename
+#include <stdlib.h>   // mkstemp
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // read, write, close, unlink
+
+#include <cstdint>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+namespace Autolab {
+
+const std::string response_entry_magic = "autolab-response 2\n";
+
+// 64-bit FNV-1a, only used to name entry files
+uint64_t hash_key(const std::string &key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string response_cache::entry_path(const std::string &key) {
+  static const char hex_digits[] = "0123456789abcdef";
+  uint64_t hash = hash_key(key);
+  std::string name(16, '0');
+  for (int i = 15; i >= 0; i--) {
+    name[i] = hex_digits[hash & 0xf];
+    hash >>= 4;
+  }
+  return directory + "/" + name;
+}
+
+bool write_fully(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    length -= written;
+  }
+  return true;
+}
+
+bool read_whole_file(const std::string &path, std::string &contents) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    return false;
+  }
+  contents.resize(info.st_size);
+  size_t total = 0;
+  while (total < contents.length()) {
+    ssize_t amount = read(fd, &contents[total], contents.length() - total);
+    if (amount < 0 && errno == EINTR) continue;
+    if (amount <= 0) break;
+    total += amount;
+  }
+  close(fd);
+  contents.resize(total);
+  return true;
+}
+
+/* An entry is the magic line, then the fetch time and the lengths of the key,
+ * the ETag and the Last-Modified value on a line, then those strings and the
+ * body.
+ */
+bool response_cache::load(const std::string &key, cached_response &entry) {
+  std::string contents;
+  if (!read_whole_file(entry_path(key), contents)) return false;
+  if (contents.compare(0, response_entry_magic.length(), response_entry_magic) != 0) {
+    return false;
+  }
+
+  std::istringstream header(contents.substr(response_entry_magic.length(), 128));
+  long long time;
+  size_t key_length, etag_length, last_modified_length;
+  if (!(header >> time >> key_length >> etag_length >> last_modified_length) ||
+      header.get() != '\n') {
+    return false;
+  }
+  size_t key_start = response_entry_magic.length() + header.tellg();
+  size_t body_start = key_start + key_length + etag_length + last_modified_length;
+  if (body_start > contents.length() ||
+      contents.compare(key_start, key_length, key) != 0) {
+    return false; // truncated, or a different key with the same hash
+  }
+
+  entry.fetched_at = time;
+  entry.etag = contents.substr(key_start + key_length, etag_length);
+  entry.last_modified = contents.substr(key_start + key_length + etag_length,
+    last_modified_length);
+  entry.body = contents.substr(body_start);
+  return true;
+}
+
+void response_cache::store(const std::string &key, const std::string &body,
+    const std::string &etag, const std::string &last_modified) {
+  std::ostringstream entry;
+  entry << response_entry_magic << (long long)std::time(nullptr) << " "
+    << key.length() << " " << etag.length() << " " << last_modified.length() << "\n"
+    << key << etag << last_modified << body;
+  std::string contents = entry.str();
+
+  std::string path = entry_path(key);
+  std::vector<char> temp_path(path.begin(), path.end());
+  const char suffix[] = ".XXXXXX";
+  temp_path.insert(temp_path.end(), suffix, suffix + sizeof(suffix));
+
+  int fd = mkstemp(temp_path.data());
+  if (fd < 0) {
+    LogDebug("[Cache] could not create entry in " << directory << Logger::endl);
+    return;
+  }
+  bool written = write_fully(fd, contents.data(), contents.length());
+  if (close(fd) < 0 || !written || rename(temp_path.data(), path.c_str()) < 0) {
+    unlink(temp_path.data());
+    LogDebug("[Cache] could not store entry " << path << Logger::endl);
+  }
+}
+
+void response_cache::invalidate(const std::string &key) {
+  unlink(entry_path(key).c_str());
+}
+
+}
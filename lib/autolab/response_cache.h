@@ -0,0 +1,54 @@
+/*
+ * On-disk store of response bodies, used by RawClient to answer reads without
+ * a round trip to the server.
+ *
+ * Each entry is a file named after a hash of its key, holding the time it was
+ * fetched, the full key (to detect hash collisions), the validators the server
+ * sent along (ETag and Last-Modified, if any) and the body. Entries are
+ * replaced by writing a temporary file and renaming it over the old one, so
+ * concurrent processes only ever see complete entries. Freshness is decided by
+ * the caller from the fetch time.
+ */
+
+#ifndef LIBAUTOLAB_RESPONSE_CACHE_H_
+#define LIBAUTOLAB_RESPONSE_CACHE_H_
+
+#include <cstddef>
+#include <ctime>
+#include <string>
+
+namespace Autolab {
+
+struct cached_response {
+  std::string body;
+  std::time_t fetched_at;
+  // validators for conditional requests, empty if the server sent none
+  std::string etag;
+  std::string last_modified;
+};
+
+class response_cache {
+public:
+  // dir must exist and be writable
+  explicit response_cache(const std::string &dir) : directory(dir) {}
+
+  // Returns false if there is no entry for key.
+  bool load(const std::string &key, cached_response &entry);
+  // Stores the entry with the current time as its fetch time. Failing to
+  // store an entry is not an error, the entry is just not cached.
+  void store(const std::string &key, const std::string &body,
+    const std::string &etag, const std::string &last_modified);
+  void invalidate(const std::string &key);
+
+private:
+  std::string directory;
+
+  std::string entry_path(const std::string &key);
+};
+
+// writes all of data, retrying after interruptions. Returns false on error.
+bool write_fully(int fd, const char *data, size_t length);
+
+}
+
+#endif /* LIBAUTOLAB_RESPONSE_CACHE_H_ */
@@ -0,0 +1,115 @@
+#include "autolab/autolab.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
+#include <string>
+#include <vector>
+
+namespace Autolab {
+
+const size_t ScoreMatrix::npos;
+
+size_t ScoreMatrix::find_problem(const std::string &name) const {
+  for (size_t col = 0; col < problem_names.size(); col++) {
+    if (problem_names[col] == name) return col;
+  }
+  return npos;
+}
+
+size_t ScoreMatrix::intern_problem(const char *name, size_t length, size_t hint) {
+  // submissions usually list their scores in the same order, so the hint
+  // almost always matches
+  if (hint < problem_names.size() &&
+      problem_names[hint].compare(0, std::string::npos, name, length) == 0) {
+    return hint;
+  }
+  for (size_t col = 0; col < problem_names.size(); col++) {
+    if (problem_names[col].compare(0, std::string::npos, name, length) == 0) {
+      return col;
+    }
+  }
+
+  size_t col = problem_names.size();
+  problem_names.emplace_back(name, length);
+  if (col < stride) return col; // room left in every row
+
+  // widen every row, doubling so that adding problems one by one is cheap
+  size_t new_stride = stride ? stride * 2 : 8;
+  std::vector<double> new_cells(versions.size() * new_stride, std::nan(""));
+  for (size_t row = 0; row < versions.size() && stride > 0; row++) {
+    std::memcpy(new_cells.data() + row * new_stride, cells.data() + row * stride,
+                stride * sizeof(double));
+  }
+  cells.swap(new_cells);
+  stride = new_stride;
+  return col;
+}
+
+size_t ScoreMatrix::add_submission(int version, std::time_t created_at,
+    const std::string &filename) {
+  size_t row = versions.size();
+  row_num_problems.push_back(problem_names.size());
+  versions.push_back(version);
+  created_ats.push_back(created_at);
+  filenames.push_back(filename);
+  cells.resize(cells.size() + stride, std::nan(""));
+  return row;
+}
+
+void ScoreMatrix::set_submission(size_t row, int version, std::time_t created_at,
+    const std::string &filename) {
+  versions[row] = version;
+  created_ats[row] = created_at;
+  filenames[row] = filename;
+}
+
+void ScoreMatrix::remove_last_submission() {
+  if (versions.empty()) return;
+  versions.pop_back();
+  created_ats.pop_back();
+  filenames.pop_back();
+  cells.resize(cells.size() - stride);
+  // the problems only the removed row had. The other rows have NaN scores in
+  // their columns, as they would for a problem that was never added.
+  problem_names.resize(row_num_problems.back());
+  row_num_problems.pop_back();
+}
+
+void ScoreMatrix::clear() {
+  problem_names.clear();
+  versions.clear();
+  created_ats.clear();
+  filenames.clear();
+  cells.clear();
+  row_num_problems.clear();
+  stride = 0;
+}
+
+// Rows are padded with NaN scores to a multiple of 8 columns, so they are
+// summed in whole groups of four, with a separate sum per lane that the
+// compiler can keep in one vector register. NaN is the only value not equal
+// to itself.
+double ScoreMatrix::total(size_t row) const {
+  const double *row_scores = scores(row);
+  double sums[4] = {0.0, 0.0, 0.0, 0.0};
+  for (size_t col = 0; col < stride; col += 4) {
+    for (size_t lane = 0; lane < 4; lane++) {
+      double score = row_scores[col + lane];
+      sums[lane] += (score == score) ? score : 0.0;
+    }
+  }
+  return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+bool ScoreMatrix::has_released_scores(size_t row) const {
+  const double *row_scores = scores(row);
+  for (size_t col = 0; col < problem_names.size(); col++) {
+    if (!std::isnan(row_scores[col])) return true;
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,121 @@
+/*
+ * simdjson backend of the element packagers in element_packagers.h, built
+ * instead of rapidjson_packagers.cpp when configured with
+ * -Djson_backend=simdjson. Uses simdjson's On Demand API, which decodes the
+ * fields in a single pass while it validates the element.
+ */
+
+#include "element_packagers.h"
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+#include <string_view>
+#include <vector>
+
+#include <simdjson.h>
+
+#include "autolab/autolab.h"
+#include "json_fields.h"
+
+namespace Autolab {
+
+static void throw_not_an_object() {
+  throw InvalidResponseException("Expected json object not found");
+}
+
+// A value of an element being iterated. On Demand reads the values in order,
+// so each one is only valid until the next member is visited.
+class ondemand_value : public json_value {
+public:
+  explicit ondemand_value(simdjson::ondemand::value v) : value(v) {}
+
+  bool get_string(const char *&str, size_t &length) override {
+    std::string_view view;
+    if (value.get_string().get(view)) return false;
+    str = view.data();
+    length = view.length();
+    return true;
+  }
+
+  bool get_int(int &result) override {
+    simdjson::ondemand::number_type type;
+    if (value.get_number_type().get(type)) return false;
+    if (type == simdjson::ondemand::number_type::signed_integer) {
+      int64_t i;
+      if (value.get_int64().get(i) || i < INT_MIN || i > INT_MAX) return false;
+      result = static_cast<int>(i);
+      return true;
+    }
+    if (type == simdjson::ondemand::number_type::unsigned_integer) {
+      uint64_t u;
+      if (value.get_uint64().get(u) || u > INT_MAX) return false;
+      result = static_cast<int>(u);
+      return true;
+    }
+    return false;
+  }
+
+  bool get_double(double &result) override {
+    simdjson::ondemand::number_type type;
+    return !value.get_number_type().get(type) &&
+      type == simdjson::ondemand::number_type::floating_point_number &&
+      !value.get_double().get(result);
+  }
+
+  bool get_bool(bool &result) override {
+    return !value.get_bool().get(result);
+  }
+
+  bool visit_members(json_member_visitor &visitor) override {
+    simdjson::ondemand::object obj;
+    if (value.get_object().get(obj)) return false;
+    for (auto member : obj) {
+      std::string_view key;
+      simdjson::ondemand::value member_value;
+      if (member.unescaped_key().get(key) || member.value().get(member_value)) {
+        throw_not_an_object();
+      }
+      ondemand_value wrapped(member_value);
+      visitor.member(key.data(), key.length(), wrapped);
+    }
+    return true;
+  }
+
+private:
+  simdjson::ondemand::value value;
+};
+
+/* On Demand needs SIMDJSON_PADDING readable bytes past the end of the input,
+ * which the streamed elements don't have. They are copied into a buffer that
+ * is reused for every element of the thread.
+ */
+struct element_parser {
+  simdjson::ondemand::parser parser;
+  std::vector<char> buffer;
+
+  void iterate(simdjson::ondemand::document &doc, const char *json, size_t length) {
+    if (buffer.size() < length + simdjson::SIMDJSON_PADDING) {
+      buffer.resize(length + simdjson::SIMDJSON_PADDING);
+    }
+    std::memcpy(buffer.data(), json, length);
+    simdjson::padded_string_view input(buffer.data(), length, buffer.size());
+    if (parser.iterate(input).get(doc)) throw_not_an_object();
+  }
+};
+
+void parse_element(const char *json, size_t length,
+    const std::function<void(json_value &)> &decode) {
+  static thread_local element_parser parser;
+  simdjson::ondemand::document doc;
+  parser.iterate(doc, json, length);
+
+  simdjson::ondemand::value root;
+  if (doc.get_value().get(root)) throw_not_an_object();
+  ondemand_value value(root);
+  decode(value);
+  if (!doc.at_end()) throw_not_an_object();
+}
+
+}
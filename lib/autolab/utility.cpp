@@ -1,9 +1,8 @@
 #include "autolab/autolab.h"
 
-#include <cstdio>
+#include <cstddef>
 #include <ctime>
 
-#include <chrono>
 #include <sstream>
 #include <iomanip>
 
@@ -14,52 +13,100 @@ namespace Autolab {
 namespace Utility {
 
 // string conversion methods
-// get time zone offset in hours (e.g. -4 means we're at UTC-04:00)
-double get_timezone_offset() {
-  std::time_t raw_time_utc;
-  std::time(&raw_time_utc);
 
-  std::tm *utc = std::gmtime(&raw_time_utc);
-  utc->tm_isdst = -1;
-  std::time_t raw_time_local = std::mktime(utc);
+// days between 1970-01-01 and the given date of the proleptic Gregorian
+// calendar (Howard Hinnant's days_from_civil).
+long days_from_civil(long year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+  unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + static_cast<long>(day_of_era) - 719468;
+}
 
-  double diff_in_seconds = std::difftime(raw_time_utc, raw_time_local);
-  return diff_in_seconds / 3600; // convert seconds to hours
+// read exactly count digits at str + pos and advance pos past them. Returns -1
+// if there aren't that many digits.
+int read_digits(const char *str, size_t length, size_t &pos, size_t count) {
+  if (pos + count > length) return -1;
+  int value = 0;
+  for (size_t i = 0; i < count; i++) {
+    unsigned digit = static_cast<unsigned char>(str[pos + i]) - '0';
+    if (digit > 9) return -1;
+    value = value * 10 + digit;
+  }
+  pos += count;
+  return value;
 }
 
-std::time_t string_to_time(std::string str_time) {
-  std::tm tms;
-  int source_timezone_offset = 0;
+bool read_char(const char *str, size_t length, size_t &pos, char c) {
+  if (pos >= length || str[pos] != c) return false;
+  pos++;
+  return true;
+}
 
-  int res = std::sscanf(str_time.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d.%*3c%3d",
-    &tms.tm_year, &tms.tm_mon, &tms.tm_mday,
-    &tms.tm_hour, &tms.tm_min, &tms.tm_sec,
-    &source_timezone_offset);
+/* parse an ISO-8601 timestamp as sent by autolab, e.g.
+ * "2017-09-01T23:59:00.000-04:00". Fractional seconds are optional, the offset
+ * may be Z, +hh, +hhmm or +hh:mm. Since std::time_t counts seconds since the
+ * epoch in UTC, the result is computed arithmetically and doesn't depend on
+ * the local time zone. Returns 0 if the string can't be parsed.
+ */
+std::time_t string_to_time(const char *str, size_t length) {
+  size_t pos = 0;
+  int year = read_digits(str, length, pos, 4);
+  bool ok = year >= 0 && read_char(str, length, pos, '-');
+  int month = read_digits(str, length, pos, 2);
+  ok = ok && month >= 1 && month <= 12 && read_char(str, length, pos, '-');
+  int day = read_digits(str, length, pos, 2);
+  ok = ok && day >= 1 && day <= 31 &&
+       (read_char(str, length, pos, 'T') || read_char(str, length, pos, ' '));
+  int hour = read_digits(str, length, pos, 2);
+  ok = ok && hour >= 0 && hour <= 23 && read_char(str, length, pos, ':');
+  int minute = read_digits(str, length, pos, 2);
+  ok = ok && minute >= 0 && minute <= 59 && read_char(str, length, pos, ':');
+  int second = read_digits(str, length, pos, 2);
+  ok = ok && second >= 0 && second <= 60;
+
+  if (ok && read_char(str, length, pos, '.')) {
+    size_t fraction_start = pos;
+    while (pos < length && str[pos] >= '0' && str[pos] <= '9') pos++;
+    ok = pos > fraction_start;
+  }
 
-  if (res != 7 /* number of parsed args */) {
+  // offset of the source time zone from UTC, in seconds
+  long offset = 0;
+  if (ok && !read_char(str, length, pos, 'Z')) {
+    int sign = 0;
+    if (read_char(str, length, pos, '+')) sign = 1;
+    else if (read_char(str, length, pos, '-')) sign = -1;
+    int offset_hours = read_digits(str, length, pos, 2);
+    int offset_minutes = 0;
+    if (pos < length) {
+      read_char(str, length, pos, ':');
+      offset_minutes = read_digits(str, length, pos, 2);
+    }
+    ok = sign != 0 && offset_hours >= 0 && offset_hours <= 23 &&
+         offset_minutes >= 0 && offset_minutes <= 59;
+    offset = sign * (offset_hours * 3600L + offset_minutes * 60L);
+  }
+  ok = ok && pos == length;
+
+  if (!ok) {
     LogDebug("string_to_time parse fail!" << Logger::endl);
     return 0;
   }
 
-  // adjust tm struct according to spec
-  // no information on whether daylight savings time is in effect
-  tms.tm_isdst = -1;
-  // adjust year to start from 1900
-  tms.tm_year -= 1900;
-  // adjust month to start with 0
-  tms.tm_mon -= 1;
-  
-  // time zone conversion
-  int net_timezone_offset = source_timezone_offset - get_timezone_offset();
-  std::time_t raw_src_time = std::mktime(&tms);
-  std::chrono::system_clock::time_point src_time =
-      std::chrono::system_clock::from_time_t(raw_src_time);
-  src_time -= std::chrono::hours(net_timezone_offset);
-  std::time_t local_time = std::chrono::system_clock::to_time_t(src_time);
+  long long seconds = days_from_civil(year, month, day) * 86400LL +
+    hour * 3600L + minute * 60L + second - offset;
+  std::time_t time = static_cast<std::time_t>(seconds);
 
-  LogDebug("Parsed time: " << std::ctime(&local_time));
+  LogDebug("Parsed time: " << std::ctime(&time));
 
-  return local_time;
+  return time;
+}
+
+std::time_t string_to_time(std::string str_time) {
+  return string_to_time(str_time.data(), str_time.length());
 }
 
 AuthorizationLevel string_to_authorization_level(std::string str_auth) {
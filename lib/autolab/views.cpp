@@ -0,0 +1,143 @@
+#include "autolab/views.h"
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+#include <rapidjson/document.h>
+
+#include "autolab/autolab.h"
+#include "json_helpers.h"
+
+namespace Autolab {
+
+/* StringView */
+
+int StringView::compare(const StringView &other) const {
+  int result = std::memcmp(ptr, other.ptr, std::min(len, other.len));
+  if (result != 0) return result;
+  if (len == other.len) return 0;
+  return len < other.len ? -1 : 1;
+}
+
+std::ostream &operator<<(std::ostream &out, const StringView &view) {
+  return out.write(view.data(), view.length());
+}
+
+/* member access */
+
+const rapidjson::Value *find_member(const rapidjson::Value &obj, const char *key) {
+  rapidjson::Value::ConstMemberIterator it = obj.FindMember(key);
+  if (it == obj.MemberEnd()) return nullptr;
+  return &it->value;
+}
+
+typedef bool (rapidjson::Value::*type_check)() const;
+
+// same checks and messages as the get_*_force helpers
+void require_member(const rapidjson::Value &obj, const char *key,
+    type_check is_type, const char *type_name) {
+  const rapidjson::Value *value = find_member(obj, key);
+  if (!value) {
+    throw InvalidResponseException(std::string("Expected key ") + key +
+      " not found in json object.");
+  }
+  if (!(value->*is_type)()) {
+    throw_unexpected_null_error(key, type_name);
+  }
+}
+
+StringView string_member(const rapidjson::Value &obj, const char *key) {
+  const rapidjson::Value *value = find_member(obj, key);
+  if (!value || !value->IsString()) return StringView();
+  return StringView(value->GetString(), value->GetStringLength());
+}
+
+int int_member(const rapidjson::Value &obj, const char *key, int fallback) {
+  const rapidjson::Value *value = find_member(obj, key);
+  if (!value || !value->IsInt()) return fallback;
+  return value->GetInt();
+}
+
+/* CourseView */
+
+void CourseView::validate(const rapidjson::Value &v) {
+  require_or_throw_invalid_response(v.IsObject(), "Expected json object not found");
+  require_member(v, "name", &rapidjson::Value::IsString, "string");
+  require_member(v, "auth_level", &rapidjson::Value::IsString, "string");
+}
+
+StringView CourseView::name() const { return string_member(*json, "name"); }
+StringView CourseView::display_name() const { return string_member(*json, "display_name"); }
+StringView CourseView::semester() const { return string_member(*json, "semester"); }
+int CourseView::late_slack() const { return int_member(*json, "late_slack", 0); }
+int CourseView::grace_days() const { return int_member(*json, "grace_days", 0); }
+
+AuthorizationLevel CourseView::auth_level() const {
+  return Utility::string_to_authorization_level(string_member(*json, "auth_level").str());
+}
+
+/* AssessmentView */
+
+void AssessmentView::validate(const rapidjson::Value &v) {
+  require_or_throw_invalid_response(v.IsObject(), "Expected json object not found");
+  require_member(v, "name", &rapidjson::Value::IsString, "string");
+  require_member(v, "start_at", &rapidjson::Value::IsString, "string");
+  require_member(v, "due_at", &rapidjson::Value::IsString, "string");
+  require_member(v, "end_at", &rapidjson::Value::IsString, "string");
+}
+
+StringView AssessmentView::name() const { return string_member(*json, "name"); }
+StringView AssessmentView::display_name() const { return string_member(*json, "display_name"); }
+StringView AssessmentView::category_name() const { return string_member(*json, "category_name"); }
+std::time_t AssessmentView::start_at() const { return get_time(start_at_field, "start_at"); }
+std::time_t AssessmentView::due_at() const { return get_time(due_at_field, "due_at"); }
+std::time_t AssessmentView::end_at() const { return get_time(end_at_field, "end_at"); }
+std::time_t AssessmentView::grading_deadline() const {
+  return get_time(grading_deadline_field, "grading_deadline");
+}
+
+// parse the timestamp the first time it is asked for
+std::time_t AssessmentView::get_time(time_field field, const char *key) const {
+  unsigned bit = 1u << field;
+  if (!(parsed_times & bit)) {
+    StringView str = string_member(*json, key);
+    times[field] = Utility::string_to_time(str.data(), str.length());
+    parsed_times |= bit;
+  }
+  return times[field];
+}
+
+bool compare_assessment_views_by_name(const AssessmentView &a, const AssessmentView &b) {
+  int result = a.name().compare(b.name());
+  if (result == 0) return a.category_name() < b.category_name();
+  return result < 0;
+}
+
+/* ProblemView */
+
+void ProblemView::validate(const rapidjson::Value &v) {
+  require_or_throw_invalid_response(v.IsObject(), "Expected json object not found");
+  require_member(v, "name", &rapidjson::Value::IsString, "string");
+}
+
+StringView ProblemView::name() const { return string_member(*json, "name"); }
+StringView ProblemView::description() const { return string_member(*json, "description"); }
+
+double ProblemView::max_score() const {
+  const rapidjson::Value *value = find_member(*json, "max_score");
+  if (!value || !value->IsDouble()) return std::nan("");
+  return value->GetDouble();
+}
+
+bool ProblemView::optional() const {
+  const rapidjson::Value *value = find_member(*json, "optional");
+  if (!value || !value->IsBool()) return false;
+  return value->GetBool();
+}
+
+}
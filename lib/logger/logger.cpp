@@ -6,6 +6,27 @@
 
 namespace Logger {
 
+  thread_local std::ostream *thread_info_stream = nullptr;
+  thread_local std::ostream *thread_fatal_stream = nullptr;
+
+  void redirect_thread_output(std::ostream *out, std::ostream *err) {
+    thread_info_stream = out;
+    thread_fatal_stream = err;
+  }
+
+  std::ostream &info_stream() {
+    return thread_info_stream ? *thread_info_stream : std::cout;
+  }
+
+  std::ostream &fatal_stream() {
+    return thread_fatal_stream ? *thread_fatal_stream : std::cerr;
+  }
+
+  bool &fatal_prefix_used() {
+    thread_local bool prefix_used = false;
+    return prefix_used;
+  }
+
   line_ending_symbol endl;
   fatal_logger fatal;
   info_logger info;
@@ -22,25 +43,25 @@ namespace Logger {
 
   template<>
   fatal_logger &fatal_logger::operator<<(line_ending_symbol) {
-    std::cerr << std::endl;
+    fatal_stream() << std::endl;
     return *this;
   }
 
   template<>
   info_logger &info_logger::operator<<(line_ending_symbol) {
-    std::cout << std::endl;
+    info_stream() << std::endl;
     return *this;
   }
   template<>
   info_logger &info_logger::operator<<(color_symbol color) {
-    std::cout << "\x1b[" << color.code << "m";
+    info_stream() << "\x1b[" << color.code << "m";
     return *this;
   }
 
   template<>
   debug_logger &debug_logger::operator<<(line_ending_symbol) {
   #ifdef PRINT_DEBUG
-    std::cout << std::endl;
+    info_stream() << std::endl;
   #endif
     return *this;
   }
@@ -19,6 +19,9 @@
  *       while debugging.
  *
  * A Logger::endl is provided to write std::out to the output.
+ *
+ * Each thread can send its output to streams of its own instead, see
+ * redirect_thread_output.
  */
 
 #ifndef AUTOLAB_LOGGER_H_
@@ -37,6 +40,16 @@
 
 namespace Logger {
 
+  // Makes the loggers write to out and err instead of std::cout and std::cerr
+  // on the calling thread, e.g. to collect the output of work running
+  // concurrently. nullptr restores the default.
+  void redirect_thread_output(std::ostream *out, std::ostream *err);
+  // where the loggers write on the calling thread
+  std::ostream &info_stream();
+  std::ostream &fatal_stream();
+  // whether Logger::fatal has written its prefix on the calling thread
+  bool &fatal_prefix_used();
+
   struct line_ending_symbol {};
 
   struct color_symbol {
@@ -44,30 +57,32 @@ namespace Logger {
   };
   
   struct fatal_logger {
-    fatal_logger() : prefix_used(false) {}
     void set_prefix(std::string new_prefix) {
       prefix = std::string(new_prefix);
     }
+    // print the prefix again on the next write
+    void reset() {
+      fatal_prefix_used() = false;
+    }
     template<class T>
     fatal_logger &operator<<(T val) {
-      if (!prefix_used) {
-        prefix_used = true;
-        std::cerr << "fatal: ";
+      if (!fatal_prefix_used()) {
+        fatal_prefix_used() = true;
+        fatal_stream() << "fatal: ";
         if (prefix.length() > 0) {
-          std::cerr << prefix << std::endl;
+          fatal_stream() << prefix << std::endl;
         }
       }
-      std::cerr << val;
+      fatal_stream() << val;
       return *this;
     }
   private:
     std::string prefix;
-    bool prefix_used;
   };
   struct info_logger {
     template<class T>
     info_logger &operator<<(T val) {
-      std::cout << val;
+      info_stream() << val;
       return *this;
     }
   };
@@ -75,7 +90,7 @@ namespace Logger {
     template<class T>
     debug_logger &operator<<(T val) {
     #ifdef PRINT_DEBUG
-      std::cout << val;
+      info_stream() << val;
     #endif
       return *this;
     }
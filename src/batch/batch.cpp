@@ -0,0 +1,206 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+#include "../cmd/cmdmap.h"
+
+// a command line of the batch, and once run, its output
+struct batch_command {
+  size_t line_number;
+  std::vector<std::string> args;
+  std::string error; // set if the line can't be run
+
+  bool done = false;
+  int status = 0;
+  std::string out;
+  std::string err;
+};
+
+/* parsing */
+
+// Splits a line into words the way a shell would, without expansions.
+// Returns false if a quote isn't closed.
+bool split_words(const std::string &line, std::vector<std::string> &words) {
+  std::string word;
+  bool in_word = false;
+  char quote = '\0';
+  for (size_t i = 0; i < line.length(); i++) {
+    char c = line[i];
+    if (quote) {
+      if (c == quote) {
+        quote = '\0';
+      } else if (c == '\\' && quote == '"' && i + 1 < line.length() &&
+          (line[i + 1] == '"' || line[i + 1] == '\\')) {
+        word.push_back(line[++i]);
+      } else {
+        word.push_back(c);
+      }
+    } else if (c == ' ' || c == '\t' || c == '\r') {
+      if (in_word) words.push_back(word);
+      word.clear();
+      in_word = false;
+    } else {
+      in_word = true;
+      if (c == '\'' || c == '"') {
+        quote = c;
+      } else if (c == '\\' && i + 1 < line.length()) {
+        word.push_back(line[++i]);
+      } else {
+        word.push_back(c);
+      }
+    }
+  }
+  if (quote) return false;
+  if (in_word) words.push_back(word);
+  return true;
+}
+
+void read_commands(std::istream &in, std::vector<batch_command> &commands) {
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#') continue;
+
+    batch_command command;
+    command.line_number = line_number;
+    if (!split_words(line, command.args)) {
+      command.error = "unterminated quote";
+    } else {
+      // lines may be written as they would be typed in a shell
+      if (command.args[0] == "autolab") {
+        command.args.erase(command.args.begin());
+      }
+      if (command.args.empty()) {
+        command.error = "no command given";
+      } else if (command.args[0] == "setup" || command.args[0] == "daemon" ||
+          command.args[0] == "batch") {
+        command.error = "'" + command.args[0] + "' can't be run in a batch";
+      }
+    }
+    commands.push_back(std::move(command));
+  }
+}
+
+/* running */
+
+void run_command(batch_command &command,
+    int (*execute)(int argc, char *argv[])) {
+  Logger::fatal.reset();
+  if (!command.error.empty()) {
+    Logger::fatal << "line " << command.line_number << ": " << command.error
+      << Logger::endl;
+    command.status = -1;
+    return;
+  }
+
+  char program_name[] = "autolab";
+  std::vector<char *> argv;
+  argv.push_back(program_name);
+  for (auto &arg : command.args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+  try {
+    command.status = execute(argv.size() - 1, argv.data());
+  } catch (std::exception &e) {
+    Logger::fatal << e.what() << Logger::endl;
+    command.status = -1;
+  }
+}
+
+// Runs commands[begin, end) on up to jobs threads, printing the output of each
+// command once it and every command before it are done.
+void run_group(std::vector<batch_command> &commands, size_t begin, size_t end,
+    unsigned jobs, int (*execute)(int argc, char *argv[])) {
+  std::atomic<size_t> next(begin);
+  std::mutex done_lock;
+  std::condition_variable done_changed;
+
+  auto worker = [&]() {
+    for (size_t i = next++; i < end; i = next++) {
+      std::ostringstream out, err;
+      Logger::redirect_thread_output(&out, &err);
+      run_command(commands[i], execute);
+      Logger::redirect_thread_output(nullptr, nullptr);
+
+      std::lock_guard<std::mutex> lock(done_lock);
+      commands[i].out = out.str();
+      commands[i].err = err.str();
+      commands[i].done = true;
+      done_changed.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  size_t count = std::min<size_t>(jobs, end - begin);
+  for (size_t i = 0; i < count; i++) {
+    workers.emplace_back(worker);
+  }
+
+  for (size_t i = begin; i < end; i++) {
+    batch_command &command = commands[i];
+    {
+      std::unique_lock<std::mutex> lock(done_lock);
+      done_changed.wait(lock, [&command]() { return command.done; });
+    }
+    std::cout << command.out << std::flush;
+    std::cerr << command.err << std::flush;
+  }
+
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+/* entry point */
+
+int run_batch(std::istream &in, unsigned jobs,
+    int (*execute)(int argc, char *argv[])) {
+  std::vector<batch_command> commands;
+  read_commands(in, commands);
+  LogDebug("[Batch] " << commands.size() << " commands read" << Logger::endl);
+
+  size_t begin = 0;
+  while (begin < commands.size()) {
+    // a run of read-only commands, or a single other command
+    size_t end = begin + 1;
+    if (commands[begin].error.empty() &&
+        is_read_only_command(commands[begin].args[0])) {
+      while (end < commands.size() && commands[end].error.empty() &&
+          is_read_only_command(commands[end].args[0])) {
+        end++;
+      }
+    }
+
+    if (jobs <= 1 || end - begin == 1) {
+      // output goes out as it is written, e.g. the progress of a submission
+      for (size_t i = begin; i < end; i++) {
+        run_command(commands[i], execute);
+      }
+    } else {
+      LogDebug("[Batch] running lines " << commands[begin].line_number << " to "
+        << commands[end - 1].line_number << " in parallel" << Logger::endl);
+      run_group(commands, begin, end, jobs, execute);
+    }
+    begin = end;
+  }
+
+  int status = 0;
+  for (auto &command : commands) {
+    if (command.status != 0) status = command.status;
+  }
+  return status;
+}
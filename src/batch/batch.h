@@ -0,0 +1,28 @@
+/*
+ * Batch mode ('autolab batch'): runs many command lines in one process.
+ *
+ * The command lines are read one per line, as they would be typed after
+ * 'autolab' in a shell: words are separated by spaces, and may be quoted with
+ * '' or "" or escaped with '\'. Blank lines and lines starting with '#' are
+ * skipped.
+ *
+ * All the commands share one client, so credentials are loaded once and
+ * connections are reused. Consecutive read-only commands are run at the same
+ * time, up to a number of jobs. Commands that change anything (submit,
+ * download, enroll) wait for the commands before them, and the commands after
+ * them wait for them. The output of each command is printed in input order,
+ * never interleaved with the output of another.
+ */
+
+#ifndef AUTOLAB_BATCH_H_
+#define AUTOLAB_BATCH_H_
+
+#include <istream>
+
+// Runs the command lines read from in, at most jobs at a time. execute runs
+// one command line and returns its exit status. Returns 0 if every command
+// succeeded, or the exit status of the last one that failed.
+int run_batch(std::istream &in, unsigned jobs,
+    int (*execute)(int argc, char *argv[]));
+
+#endif /* AUTOLAB_BATCH_H_ */
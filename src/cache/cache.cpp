@@ -1,10 +1,16 @@
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h> // unlink
 
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <ostream>
 #include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "logger.h"
 
@@ -12,8 +18,11 @@
 #include "../file/file_utils.h"
 
 #include "cache.h"
+#include "metadata_cache.h"
 
-const std::string courses_cache_filename = "courses.txt";
+const std::string metadata_cache_filename = "metadata";
+const std::string connection_cache_filename = "connections";
+const std::string response_cache_dirname = "responses";
 const std::string cache_dirname = "cache";
 
 std::string get_cache_dir_full_path() {
@@ -23,19 +32,18 @@ std::string get_cache_dir_full_path() {
   return cache_dir_full_path;
 }
 
-std::string get_courses_cache_file_full_path() {
-  std::string courses_cache_file_full_path = get_cache_dir_full_path();
-  courses_cache_file_full_path.append("/");
-  courses_cache_file_full_path.append(courses_cache_filename);
-  return courses_cache_file_full_path;
+std::string get_metadata_cache_file_full_path() {
+  std::string metadata_cache_file_full_path = get_cache_dir_full_path();
+  metadata_cache_file_full_path.append("/");
+  metadata_cache_file_full_path.append(metadata_cache_filename);
+  return metadata_cache_file_full_path;
 }
 
-std::string get_asmts_cache_file_full_path(std::string course_id) {
-  std::string asmts_cache_file_full_path = get_cache_dir_full_path();
-  asmts_cache_file_full_path.append("/");
-  asmts_cache_file_full_path.append(course_id);
-  asmts_cache_file_full_path.append(".txt");
-  return asmts_cache_file_full_path;
+std::string get_connection_cache_file_full_path() {
+  std::string connection_cache_file_full_path = get_cache_dir_full_path();
+  connection_cache_file_full_path.append("/");
+  connection_cache_file_full_path.append(connection_cache_filename);
+  return connection_cache_file_full_path;
 }
 
 bool check_and_create_cache_directory() {
@@ -49,60 +57,197 @@ bool check_and_create_cache_directory() {
   return false;
 }
 
-void print_cache_entry(std::string filename) {
-  if (!file_exists(filename.c_str())) {
-    return; // no need to print anything in this case
+/* metadata cache file */
+void load_metadata_cache(std::vector<cached_course> &courses) {
+  metadata_file file;
+  if (file.open(get_metadata_cache_file_full_path())) {
+    load_metadata(file, courses);
+  } else {
+    courses.clear();
   }
+}
 
-  std::ifstream cache_file;
-  cache_file.open(filename.c_str());
-
-  std::string curr_line;
+bool open_metadata_cache(metadata_file &file) {
+  return file.open(get_metadata_cache_file_full_path());
+}
 
-  // Read through the cache file line by line, cat to Logger::info
-  while (std::getline(cache_file, curr_line)) {
-    Logger::info << curr_line << Logger::endl;
-  }
+void save_metadata_cache(std::vector<cached_course> &courses) {
+  check_and_create_cache_directory();
 
-  cache_file.close();
+  std::string cache_contents = serialize_metadata(courses);
+  write_file_atomic(get_metadata_cache_file_full_path().c_str(),
+                    cache_contents.c_str(), cache_contents.length());
 }
 
-/* courses cache file */
-void update_course_cache_entry(std::vector<Autolab::Course> &courses) {
-  check_and_create_cache_directory();
+// updates load, change and save the whole file, so commands running at the
+// same time (see batch/batch.h) take turns
+std::mutex metadata_cache_lock;
 
-  std::ostringstream out;
+// the cached course with the given name, added if there is none yet
+cached_course &find_or_add_course(std::vector<cached_course> &courses,
+    const std::string &name) {
   for (auto &c : courses) {
-    out << "  " << c.name << " (" << c.display_name << ")\n";
+    if (c.name == name) return c;
   }
-  std::string cache_contents = out.str();
+  courses.push_back({name, "", 0, {}});
+  return courses.back();
+}
 
-  write_file(get_courses_cache_file_full_path().c_str(),
-             cache_contents.c_str(), cache_contents.length());
+cached_asmt &find_or_add_asmt(cached_course &course, const std::string &name) {
+  for (auto &a : course.asmts) {
+    if (a.name == name) return a;
+  }
+  course.asmts.push_back({name, "", 0, 0, 0, 0, {}});
+  return course.asmts.back();
+}
+
+/* courses */
+void update_course_cache_entry(Autolab::ViewList<Autolab::CourseView> &courses) {
+  std::lock_guard<std::mutex> guard(metadata_cache_lock);
+  std::vector<cached_course> cache;
+  load_metadata_cache(cache);
+
+  // courses that are no longer listed are dropped, unless they were only
+  // cached because their assessments were looked up directly
+  std::vector<cached_course> new_cache;
+  for (auto &c : cache) {
+    if (!(c.flags & metadata_listed)) new_cache.push_back(std::move(c));
+  }
+  for (auto &c : courses) {
+    std::string name = c.name().str();
+    cached_course *old = nullptr;
+    for (auto &o : cache) {
+      if (o.name == name) old = &o;
+    }
+    cached_course &course = find_or_add_course(new_cache, name);
+    if (old && old->flags & metadata_has_children) {
+      course.asmts = std::move(old->asmts);
+      course.flags |= metadata_has_children;
+    }
+    course.display_name = c.display_name().str();
+    course.flags |= metadata_listed;
+  }
+  save_metadata_cache(new_cache);
 
   LogDebug("[Cache] courses cache saved" << Logger::endl);
 }
 
 void print_course_cache_entry() {
-  print_cache_entry(get_courses_cache_file_full_path());
+  metadata_file file;
+  if (!file.open(get_metadata_cache_file_full_path())) {
+    return; // no need to print anything in this case
+  }
+
+  for (uint32_t i = 0; i < file.num_courses(); i++) {
+    const metadata_course &c = file.courses()[i];
+    if (!(c.flags & metadata_listed)) continue;
+    Logger::info << "  " << file.string(c.name) << " ("
+      << file.string(c.display_name) << ")" << Logger::endl;
+  }
 }
 
-/* asmts cache file */
-void update_asmt_cache_entry(std::string course_id, std::vector<Autolab::Assessment> &asmts) {
-  check_and_create_cache_directory();
+/* asmts */
+void update_asmt_cache_entry(std::string course_id, Autolab::ViewList<Autolab::AssessmentView> &asmts) {
+  std::lock_guard<std::mutex> guard(metadata_cache_lock);
+  std::vector<cached_course> cache;
+  load_metadata_cache(cache);
 
-  std::ostringstream out;
+  cached_course &course = find_or_add_course(cache, course_id);
+  std::vector<cached_asmt> old_asmts;
+  old_asmts.swap(course.asmts);
   for (auto &a : asmts) {
-    out << "  " << a.name << " (" << a.display_name << ")\n";
+    cached_asmt asmt = {a.name().str(), a.display_name().str(),
+      a.start_at(), a.due_at(), a.end_at(), metadata_listed, {}};
+    // problems don't change with the listing, keep them
+    for (auto &o : old_asmts) {
+      if (o.name == asmt.name && (o.flags & metadata_has_children)) {
+        asmt.problems = std::move(o.problems);
+        asmt.flags |= metadata_has_children;
+      }
+    }
+    course.asmts.push_back(std::move(asmt));
   }
-  std::string cache_contents = out.str();
-
-  write_file(get_asmts_cache_file_full_path(course_id).c_str(),
-             cache_contents.c_str(), cache_contents.length());
+  course.flags |= metadata_has_children;
+  save_metadata_cache(cache);
 
   LogDebug("[Cache] asmts cache saved for course: " << course_id << Logger::endl);
 }
 
 void print_asmt_cache_entry(std::string course_id) {
-  print_cache_entry(get_asmts_cache_file_full_path(course_id));
+  metadata_file file;
+  if (!file.open(get_metadata_cache_file_full_path())) return;
+
+  const metadata_course *course = file.find_course(
+    Autolab::StringView(course_id.c_str(), course_id.length()));
+  if (!course) return;
+
+  const metadata_asmt *asmts = file.asmts(*course);
+  for (uint32_t i = 0; i < course->num_asmts; i++) {
+    if (!(asmts[i].flags & metadata_listed)) continue;
+    Logger::info << "  " << file.string(asmts[i].name) << " ("
+      << file.string(asmts[i].display_name) << ")" << Logger::endl;
+  }
+}
+
+/* problems */
+void update_problem_cache_entry(std::string course_id, std::string asmt_id,
+    Autolab::ViewList<Autolab::ProblemView> &problems) {
+  std::lock_guard<std::mutex> guard(metadata_cache_lock);
+  std::vector<cached_course> cache;
+  load_metadata_cache(cache);
+
+  cached_asmt &asmt = find_or_add_asmt(find_or_add_course(cache, course_id), asmt_id);
+  asmt.problems.clear();
+  for (auto &p : problems) {
+    asmt.problems.push_back({p.name().str(), p.max_score()});
+  }
+  asmt.flags |= metadata_has_children;
+  save_metadata_cache(cache);
+
+  LogDebug("[Cache] problems cache saved for " << course_id << ":" << asmt_id << Logger::endl);
+}
+
+/* connection cache file */
+void update_connection_cache_entry(std::string contents) {
+  check_and_create_cache_directory();
+
+  write_file_atomic(get_connection_cache_file_full_path().c_str(),
+                    contents.c_str(), contents.length());
+
+  LogDebug("[Cache] connection cache saved" << Logger::endl);
+}
+
+std::string read_connection_cache_entry() {
+  std::string filename = get_connection_cache_file_full_path();
+  if (!file_exists(filename.c_str())) return "";
+
+  std::ifstream cache_file(filename.c_str());
+  std::ostringstream contents;
+  contents << cache_file.rdbuf();
+  return contents.str();
+}
+
+/* response cache directory */
+std::string get_response_cache_dir() {
+  check_and_create_cache_directory();
+  std::string cache_dir = get_cache_dir_full_path();
+  if (!dir_find(cache_dir.c_str(), response_cache_dirname.c_str(), true)) {
+    create_dir((cache_dir + "/" + response_cache_dirname).c_str());
+  }
+  return cache_dir + "/" + response_cache_dirname;
+}
+
+void clear_response_cache() {
+  std::string dir = get_cache_dir_full_path() + "/" + response_cache_dirname;
+  DIR *d = opendir(dir.c_str());
+  if (!d) return;
+
+  struct dirent *entry;
+  while ((entry = readdir(d))) {
+    if (entry->d_name[0] == '.') continue;
+    unlink((dir + "/" + entry->d_name).c_str());
+  }
+  closedir(d);
+
+  LogDebug("[Cache] response cache cleared" << Logger::endl);
 }
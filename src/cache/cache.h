@@ -4,13 +4,33 @@
 #include <string>
 
 #include "autolab/autolab.h"
+#include "autolab/views.h"
 
-/* courses cache file */
-void update_course_cache_entry(std::vector<Autolab::Course> &courses);
+class metadata_file;
+
+/* metadata cache file, see metadata_cache.h */
+// maps the cache file for reading. Returns false if there is none yet.
+bool open_metadata_cache(metadata_file &file);
+
+// courses
+void update_course_cache_entry(Autolab::ViewList<Autolab::CourseView> &courses);
 void print_course_cache_entry();
 
-/* asmts cache file */
-void update_asmt_cache_entry(std::string course_id, std::vector<Autolab::Assessment> &asmts);
+// asmts, including their deadlines
+void update_asmt_cache_entry(std::string course_id, Autolab::ViewList<Autolab::AssessmentView> &asmts);
 void print_asmt_cache_entry(std::string course_id);
 
+// problems
+void update_problem_cache_entry(std::string course_id, std::string asmt_id,
+  Autolab::ViewList<Autolab::ProblemView> &problems);
+
+/* response cache directory, see Autolab::Client::enable_response_cache */
+std::string get_response_cache_dir();
+// e.g. when a different user is set up
+void clear_response_cache();
+
+/* connection cache file */
+void update_connection_cache_entry(std::string contents);
+std::string read_connection_cache_entry();
+
 #endif /* AUTOLAB_CACHE_H_ */
@@ -0,0 +1,269 @@
+#include "metadata_cache.h"
+
+#include <fcntl.h>    // open
+#include <string.h>
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "autolab/views.h"
+
+const char metadata_magic[4] = {'A', 'L', 'M', 'C'};
+
+static_assert(sizeof(metadata_header) == 32, "unexpected header layout");
+static_assert(sizeof(metadata_course) == 32, "unexpected course record layout");
+static_assert(sizeof(metadata_asmt) == 56, "unexpected asmt record layout");
+static_assert(sizeof(metadata_problem) == 16, "unexpected problem record layout");
+
+/* reading */
+
+metadata_file::metadata_file() :
+  mapping(nullptr), mapping_size(0), header(nullptr), course_records(nullptr),
+  asmt_records(nullptr), problem_records(nullptr), strings(nullptr) {}
+
+metadata_file::~metadata_file() {
+  if (mapping) munmap(mapping, mapping_size);
+}
+
+bool metadata_file::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(metadata_header)) {
+    close(fd);
+    return false;
+  }
+  mapping_size = info.st_size;
+  mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    return false;
+  }
+
+  const char *base = static_cast<const char *>(mapping);
+  header = reinterpret_cast<const metadata_header *>(base);
+  if (memcmp(header->magic, metadata_magic, sizeof(metadata_magic)) != 0 ||
+      header->version != metadata_cache_version ||
+      header->byte_order != metadata_byte_order) {
+    header = nullptr;
+    return false;
+  }
+
+  // sections follow each other in this order, each 8-byte aligned
+  uint64_t courses_end = sizeof(metadata_header) +
+    (uint64_t)header->num_courses * sizeof(metadata_course);
+  uint64_t asmts_end = courses_end + (uint64_t)header->num_asmts * sizeof(metadata_asmt);
+  uint64_t problems_end = asmts_end + (uint64_t)header->num_problems * sizeof(metadata_problem);
+  if (problems_end + header->strings_size > mapping_size) {
+    header = nullptr;
+    return false;
+  }
+  course_records = reinterpret_cast<const metadata_course *>(base + sizeof(metadata_header));
+  asmt_records = reinterpret_cast<const metadata_asmt *>(base + courses_end);
+  problem_records = reinterpret_cast<const metadata_problem *>(base + asmts_end);
+  strings = base + problems_end;
+
+  if (!validate()) {
+    header = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// checks that every range and string of every record lies inside the file, so
+// the accessors don't have to.
+bool metadata_file::validate() const {
+  auto valid_string = [this](const metadata_string &s) {
+    return (uint64_t)s.offset + s.length <= header->strings_size;
+  };
+  for (uint32_t i = 0; i < header->num_courses; i++) {
+    const metadata_course &c = course_records[i];
+    if (!valid_string(c.name) || !valid_string(c.display_name) ||
+        (uint64_t)c.first_asmt + c.num_asmts > header->num_asmts) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_asmts; i++) {
+    const metadata_asmt &a = asmt_records[i];
+    if (!valid_string(a.name) || !valid_string(a.display_name) ||
+        (uint64_t)a.first_problem + a.num_problems > header->num_problems) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_problems; i++) {
+    if (!valid_string(problem_records[i].name)) return false;
+  }
+  return true;
+}
+
+// binary search for the record with the given name in a range sorted by name
+template <typename Record>
+const Record *find_record(const metadata_file &file, const Record *records,
+    uint32_t count, Autolab::StringView name) {
+  const Record *end = records + count;
+  const Record *it = std::lower_bound(records, end, name,
+    [&file](const Record &r, const Autolab::StringView &n) {
+      return file.string(r.name) < n;
+    });
+  if (it == end || file.string(it->name) != name) return nullptr;
+  return it;
+}
+
+const metadata_course *metadata_file::find_course(Autolab::StringView name) const {
+  if (!header) return nullptr;
+  return find_record(*this, course_records, header->num_courses, name);
+}
+
+const metadata_asmt *metadata_file::find_asmt(const metadata_course &course,
+    Autolab::StringView name) const {
+  return find_record(*this, asmts(course), course.num_asmts, name);
+}
+
+// the range of records with names starting with prefix, in a range sorted by
+// name. Names with the prefix sort after it and before anything greater than
+// it that doesn't start with it.
+template <typename Record>
+void find_record_range(const metadata_file &file, const Record *records,
+    uint32_t count, Autolab::StringView prefix, const Record *&begin,
+    const Record *&end) {
+  auto name_prefix = [&file, &prefix](const Record &r) {
+    Autolab::StringView name = file.string(r.name);
+    return Autolab::StringView(name.data(), std::min(name.length(), prefix.length()));
+  };
+  begin = std::lower_bound(records, records + count, prefix,
+    [&name_prefix](const Record &r, const Autolab::StringView &p) {
+      return name_prefix(r) < p;
+    });
+  end = std::upper_bound(begin, records + count, prefix,
+    [&name_prefix](const Autolab::StringView &p, const Record &r) {
+      return p < name_prefix(r);
+    });
+}
+
+void metadata_file::find_courses(Autolab::StringView prefix,
+    const metadata_course *&begin, const metadata_course *&end) const {
+  find_record_range(*this, course_records, num_courses(), prefix, begin, end);
+}
+
+void metadata_file::find_asmts(const metadata_course &course,
+    Autolab::StringView prefix, const metadata_asmt *&begin,
+    const metadata_asmt *&end) const {
+  find_record_range(*this, asmts(course), course.num_asmts, prefix, begin, end);
+}
+
+/* writing */
+
+void load_metadata(const metadata_file &file, std::vector<cached_course> &courses) {
+  courses.clear();
+  courses.reserve(file.num_courses());
+  for (uint32_t i = 0; i < file.num_courses(); i++) {
+    const metadata_course &c = file.courses()[i];
+    courses.emplace_back();
+    cached_course &course = courses.back();
+    course.name = file.string(c.name).str();
+    course.display_name = file.string(c.display_name).str();
+    course.flags = c.flags;
+
+    const metadata_asmt *asmts = file.asmts(c);
+    for (uint32_t j = 0; j < c.num_asmts; j++) {
+      const metadata_asmt &a = asmts[j];
+      course.asmts.emplace_back();
+      cached_asmt &asmt = course.asmts.back();
+      asmt.name = file.string(a.name).str();
+      asmt.display_name = file.string(a.display_name).str();
+      asmt.start_at = a.start_at;
+      asmt.due_at = a.due_at;
+      asmt.end_at = a.end_at;
+      asmt.flags = a.flags;
+
+      const metadata_problem *problems = file.problems(a);
+      for (uint32_t k = 0; k < a.num_problems; k++) {
+        asmt.problems.push_back({file.string(problems[k].name).str(),
+                                 problems[k].max_score});
+      }
+    }
+  }
+}
+
+// appends s to the string table and returns a reference to it
+metadata_string add_string(std::string &table, const std::string &s) {
+  metadata_string ref = {(uint32_t)table.length(), (uint32_t)s.length()};
+  table.append(s);
+  return ref;
+}
+
+template <typename Record>
+bool compare_by_name(const Record &a, const Record &b) {
+  return a.name < b.name;
+}
+
+template <typename Record>
+void append_records(std::string &out, const std::vector<Record> &records) {
+  out.append(reinterpret_cast<const char *>(records.data()),
+             records.size() * sizeof(Record));
+}
+
+std::string serialize_metadata(std::vector<cached_course> &courses) {
+  std::vector<metadata_course> course_records;
+  std::vector<metadata_asmt> asmt_records;
+  std::vector<metadata_problem> problem_records;
+  std::string strings;
+
+  std::sort(courses.begin(), courses.end(), compare_by_name<cached_course>);
+  for (auto &course : courses) {
+    metadata_course c;
+    memset(&c, 0, sizeof(c));
+    c.name = add_string(strings, course.name);
+    c.display_name = add_string(strings, course.display_name);
+    c.flags = course.flags;
+    c.first_asmt = asmt_records.size();
+    c.num_asmts = course.asmts.size();
+    course_records.push_back(c);
+
+    std::sort(course.asmts.begin(), course.asmts.end(), compare_by_name<cached_asmt>);
+    for (auto &asmt : course.asmts) {
+      metadata_asmt a;
+      memset(&a, 0, sizeof(a));
+      a.name = add_string(strings, asmt.name);
+      a.display_name = add_string(strings, asmt.display_name);
+      a.start_at = asmt.start_at;
+      a.due_at = asmt.due_at;
+      a.end_at = asmt.end_at;
+      a.flags = asmt.flags;
+      a.first_problem = problem_records.size();
+      a.num_problems = asmt.problems.size();
+      asmt_records.push_back(a);
+
+      for (auto &problem : asmt.problems) {
+        metadata_problem p;
+        memset(&p, 0, sizeof(p));
+        p.name = add_string(strings, problem.name);
+        p.max_score = problem.max_score;
+        problem_records.push_back(p);
+      }
+    }
+  }
+
+  metadata_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, metadata_magic, sizeof(metadata_magic));
+  header.version = metadata_cache_version;
+  header.byte_order = metadata_byte_order;
+  header.num_courses = course_records.size();
+  header.num_asmts = asmt_records.size();
+  header.num_problems = problem_records.size();
+  header.strings_size = strings.length();
+
+  std::string out(reinterpret_cast<const char *>(&header), sizeof(header));
+  append_records(out, course_records);
+  append_records(out, asmt_records);
+  append_records(out, problem_records);
+  out.append(strings);
+  return out;
+}
@@ -0,0 +1,163 @@
+/*
+ * Binary file format of the metadata cache.
+ *
+ * The cache holds the courses, assessments (with their deadlines) and problems
+ * seen so far. A file is a header followed by arrays of fixed-size records for
+ * courses, assessments and problems, then a table of the strings the records
+ * refer to. Courses are sorted by name, and the assessments of a course are
+ * stored next to each other, sorted by name, so a course's range doubles as an
+ * index. The problems of an assessment are stored next to each other in the
+ * order the server lists them. Readers map the file and binary search the
+ * records in place, without parsing anything.
+ *
+ * Records are stored in the byte order of the machine that wrote them. Files
+ * from a machine with a different byte order, or with a different format
+ * version, are treated as missing.
+ */
+
+#ifndef AUTOLAB_METADATA_CACHE_H_
+#define AUTOLAB_METADATA_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "autolab/views.h"
+
+/* file format */
+
+const uint32_t metadata_cache_version = 1;
+const uint32_t metadata_byte_order = 0x01020304;
+
+struct metadata_string {
+  uint32_t offset; // into the string table
+  uint32_t length;
+};
+
+struct metadata_header {
+  char magic[4];          // "ALMC"
+  uint32_t version;       // metadata_cache_version
+  uint32_t byte_order;    // metadata_byte_order, as seen by the writer
+  uint32_t num_courses;
+  uint32_t num_asmts;
+  uint32_t num_problems;
+  uint32_t strings_size;
+  uint32_t reserved;
+};
+
+enum metadata_flags {
+  // the record was part of the last full listing (of courses, or of the
+  // assessments of its course)
+  metadata_listed = 1,
+  // the assessments of a course, or the problems of an assessment, are cached
+  metadata_has_children = 2,
+};
+
+struct metadata_course {
+  metadata_string name;
+  metadata_string display_name;
+  uint32_t flags;
+  uint32_t first_asmt;
+  uint32_t num_asmts;
+  uint32_t reserved;
+};
+
+struct metadata_asmt {
+  metadata_string name;
+  metadata_string display_name;
+  int64_t start_at;
+  int64_t due_at;
+  int64_t end_at;
+  uint32_t flags;
+  uint32_t first_problem;
+  uint32_t num_problems;
+  uint32_t reserved;
+};
+
+struct metadata_problem {
+  metadata_string name;
+  double max_score; // NaN if the problem has none
+};
+
+/* reading */
+
+// a read-only mapping of a cache file
+class metadata_file {
+public:
+  metadata_file();
+  ~metadata_file();
+  metadata_file(const metadata_file &) = delete;
+  metadata_file &operator=(const metadata_file &) = delete;
+
+  // maps the file. Returns false if it doesn't exist or isn't a valid cache.
+  bool open(const std::string &path);
+  bool is_open() const { return header != nullptr; }
+
+  uint32_t num_courses() const { return header ? header->num_courses : 0; }
+  const metadata_course *courses() const { return course_records; }
+  const metadata_asmt *asmts(const metadata_course &course) const {
+    return asmt_records + course.first_asmt;
+  }
+  const metadata_problem *problems(const metadata_asmt &asmt) const {
+    return problem_records + asmt.first_problem;
+  }
+
+  // nullptr if not found
+  const metadata_course *find_course(Autolab::StringView name) const;
+  const metadata_asmt *find_asmt(const metadata_course &course, Autolab::StringView name) const;
+  // the records whose names start with prefix, as the range [begin, end)
+  void find_courses(Autolab::StringView prefix, const metadata_course *&begin,
+    const metadata_course *&end) const;
+  void find_asmts(const metadata_course &course, Autolab::StringView prefix,
+    const metadata_asmt *&begin, const metadata_asmt *&end) const;
+
+  Autolab::StringView string(const metadata_string &s) const {
+    return Autolab::StringView(strings + s.offset, s.length);
+  }
+
+private:
+  void *mapping;
+  size_t mapping_size;
+  const metadata_header *header;
+  const metadata_course *course_records;
+  const metadata_asmt *asmt_records;
+  const metadata_problem *problem_records;
+  const char *strings;
+
+  bool validate() const;
+};
+
+/* writing */
+
+// The whole cache is small, so writers load it into these structs, change
+// them, then write out a new file.
+struct cached_problem {
+  std::string name;
+  double max_score;
+};
+
+struct cached_asmt {
+  std::string name;
+  std::string display_name;
+  std::time_t start_at;
+  std::time_t due_at;
+  std::time_t end_at;
+  uint32_t flags;
+  std::vector<cached_problem> problems;
+};
+
+struct cached_course {
+  std::string name;
+  std::string display_name;
+  uint32_t flags;
+  std::vector<cached_asmt> asmts;
+};
+
+void load_metadata(const metadata_file &file, std::vector<cached_course> &courses);
+// sorts courses and their assessments by name
+std::string serialize_metadata(std::vector<cached_course> &courses);
+
+#endif /* AUTOLAB_METADATA_CACHE_H_ */
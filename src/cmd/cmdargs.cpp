@@ -18,13 +18,13 @@ void error_pos_after_opt(std::string error_arg) {
   Logger::fatal << "Invalid command line argument '" << error_arg << "'." << Logger::endl
       << "Note that all options must come after all positional arguments (e.g. commands)."
       << Logger::endl << "For detailed usage, run with '-h'." << Logger::endl;
-  exit(-1);
+  throw command_exit{-1};
 }
 
 void error_opt_missing_arg(std::string opt_name) {
   Logger::fatal << "Required parameter for '" << opt_name << "' missing." << Logger::endl
       << "For detailed usage, run with '-h'." << Logger::endl;
-  exit(-1);
+  throw command_exit{-1};
 }
 
 // helpers
@@ -74,7 +74,7 @@ void cmdargs::setup_done() {
   // check for help
   if (has_option("-h","--help") || required_args > nargs()) {
     print_help();
-    exit(0);
+    throw command_exit{0};
   }
 }
 
@@ -45,4 +45,13 @@ public:
 
 bool parse_cmdargs(cmdargs &cmd, int argc, char *argv[]);
 
+/* Thrown instead of calling exit() when a command stops early, e.g. after
+ * printing its help or an error. It is caught where the command was started,
+ * so commands can also run inside a process that outlives them (see
+ * daemon/daemon.h).
+ */
+struct command_exit {
+  int status;
+};
+
 #endif /* AUTOLAB_CMDARGS_H_ */
\ No newline at end of file
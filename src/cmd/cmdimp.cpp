@@ -1,10 +1,15 @@
 #include <cmath>
+#include <cstdlib>
 #include <ctime>
 
+#include <fcntl.h>  // open
+#include <unistd.h> // fork, dup2
+
 #include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread> // sleep_for
@@ -26,13 +31,94 @@
 
 Autolab::Client client(server_domain, client_id, client_secret, redirect_uri, store_tokens);
 
+// size in bytes above which responses are kept on disk instead of in memory,
+// e.g. on hosts with tight per-user memory limits. 0 turns spilling off.
+void load_spill_threshold() {
+  const char *setting = getenv("AUTOLAB_SPILL_THRESHOLD");
+  if (!setting || !*setting) return;
+  char *end = nullptr;
+  unsigned long long bytes = strtoull(setting, &end, 10);
+  if (*end != '\0') {
+    LogDebug("Ignoring invalid AUTOLAB_SPILL_THRESHOLD: " << setting << Logger::endl);
+    return;
+  }
+  client.set_spill_threshold(bytes);
+}
+
+bool client_initialized = false;
+std::time_t tokens_loaded_at = 0;
+std::mutex client_init_lock;
+
+// In a process running several commands (the daemon, or a batch), later calls
+// only reload the tokens, and only if another process stored new ones.
 bool init_autolab_client() {
-  std::string at, rt;
-  if (!load_tokens(at, rt)) return false;
-  client.set_tokens(at, rt);
+  std::lock_guard<std::mutex> guard(client_init_lock);
+  std::time_t tokens_modified_at = tokens_last_modified();
+  if (tokens_modified_at == 0) return false; // no token cache: no user
+  if (client_initialized && tokens_modified_at == tokens_loaded_at) return true;
+
+  // decrypted on the first request, commands answered from the caches don't
+  // need them
+  client.set_token_loader(load_tokens);
+  tokens_loaded_at = tokens_modified_at;
+  if (client_initialized) return true;
+  client_initialized = true;
+
+  // other autolab processes may refresh the same tokens
+  client.set_token_storage_lock(lock_token_cache, unlock_token_cache);
+  load_spill_threshold();
+  client.enable_response_cache(get_response_cache_dir());
+  client.import_connection_cache(read_connection_cache_entry());
   return true;
 }
 
+// keep the server address and TLS sessions around for the next invocation
+void save_autolab_client_state() {
+  if (client.get_connection_stats().transfers == 0) return;
+  update_connection_cache_entry(client.export_connection_cache());
+}
+
+// Tokens about to expire are refreshed first, so the next command doesn't
+// have to, and the revalidation uses the new ones.
+void revalidate_stale_responses() {
+  try {
+    client.refresh_expiring_tokens();
+    client.revalidate_stale_responses();
+  } catch (...) {
+    // the stale responses stay cached, and are tried again next time
+  }
+}
+
+// Responses that were served from the cache while stale are fetched again by
+// a child process after the command is done, so the shell gets its prompt
+// back right away and the next command sees fresh data. Tokens about to
+// expire are refreshed there too.
+//
+// The child inherits the client's open connections. It leaves them to the
+// parent and makes its own, and the parent must not close them (see
+// cmdimp.h).
+bool revalidate_in_background() {
+  if (!client.has_stale_responses() && !client.tokens_expire_soon()) return false;
+
+  std::cout.flush();
+  std::cerr.flush();
+  pid_t pid = fork();
+  if (pid < 0) return false; // revalidated next time
+  if (pid > 0) return true;
+
+  client.discard_inherited_connections();
+
+  int null_fd = open("/dev/null", O_RDWR);
+  if (null_fd >= 0) {
+    dup2(null_fd, STDIN_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+  }
+  revalidate_stale_responses();
+  _exit(0);
+}
+
 void print_not_in_asmt_dir_error() {
   Logger::fatal << "Not inside an autolab assessment directory: .autolab-asmt not found" << Logger::endl
     << Logger::endl
@@ -71,7 +157,7 @@ void parse_course_and_asmt(std::string raw_input, std::string &course, std::stri
   std::string::size_type split_pos = raw_input.find(":");
   if (split_pos == std::string::npos) {
     Logger::fatal << "Failed to parse course name and assessment name: " << raw_input << Logger::endl;
-    exit(0);
+    throw command_exit{0};
   }
   course = raw_input.substr(0, split_pos);
   asmt = raw_input.substr(split_pos + 1, std::string::npos);
@@ -88,7 +174,7 @@ void check_names_with_asmt_file(std::string &course_name, std::string &asmt_name
   bool found_asmt_file = read_asmt_file(course_name_config, asmt_name_config);
   if (!found_asmt_file && !user_specified_names) {
     print_not_in_asmt_dir_error();
-    exit(0);
+    throw command_exit{0};
   }
 
   if (found_asmt_file && user_specified_names) {
@@ -97,7 +183,7 @@ void check_names_with_asmt_file(std::string &course_name, std::string &asmt_name
         << "Provided names:   " << course_name  << ":" << asmt_name << Logger::endl
         << "Configured names: " << course_name_config << ":" << asmt_name_config << Logger::endl << Logger::endl
         << "Please resolve this conflict, or use the '-f' option to force the use of the provided names." << Logger::endl;
-      exit(0);
+      throw command_exit{0};
     }
   }
 
@@ -111,42 +197,57 @@ void check_names_with_asmt_file(std::string &course_name, std::string &asmt_name
 
 /* table creators */
 
-// create a submissions scores table, returns the number of data rows (not
-// incl. the header row).
+// create a submissions scores table from the rows of scores starting at
+// first_row, returns the number of data rows (not incl. the header row).
 int create_scores_table(
     std::vector<std::vector<std::string>> &table,
     std::vector<Autolab::Problem> &problems,
-    std::vector<Autolab::Submission> &subs,
+    Autolab::ScoreMatrix &scores,
+    std::size_t first_row,
     std::size_t max_num_subs) {
 
-  // prepare table header
+  // prepare table header, and find the column of each problem once
   std::vector<std::string> header;
+  std::vector<std::size_t> columns;
+  double max_total = 0.0;
   header.push_back("version");
   for (auto &p : problems) {
     std::string column(p.name);
     if (!std::isnan(p.max_score)) {
       column += " (" + double_to_string(p.max_score, 1) + ")";
     }
+    max_total += p.max_score; // NaN unless every problem has a max score
     header.push_back(column);
+    columns.push_back(scores.find_problem(p.name));
   }
+  std::string total_column("total");
+  if (problems.size() > 0 && !std::isnan(max_total)) {
+    total_column += " (" + double_to_string(max_total, 1) + ")";
+  }
+  header.push_back(total_column);
   table.push_back(header);
 
   // prepare table body
-  int nprint = std::min(subs.size(), max_num_subs);
+  std::size_t num_subs = scores.num_submissions();
+  int nprint = first_row < num_subs ? std::min(num_subs - first_row, max_num_subs) : 0;
   for (int i = 0; i < nprint; i++) {
+    std::size_t row_idx = first_row + i;
     std::vector<std::string> row;
-    Autolab::Submission &s = subs[i];
-    row.push_back(std::to_string(s.version));
-
-    auto &scores_map = s.scores;
-    for (auto &p : problems) {
-      auto score = scores_map.find(p.name); // find by problem name
-      if (score != scores_map.end() && !std::isnan(score->second)) {
-        row.push_back(double_to_string(score->second, 1));
+    row.push_back(std::to_string(scores.version(row_idx)));
+
+    const double *row_scores = scores.scores(row_idx);
+    for (std::size_t col : columns) {
+      if (col != Autolab::ScoreMatrix::npos && !std::isnan(row_scores[col])) {
+        row.push_back(double_to_string(row_scores[col], 1));
       } else {
         row.push_back("--");
       }
     }
+    if (scores.has_released_scores(row_idx)) {
+      row.push_back(double_to_string(scores.total(row_idx), 1));
+    } else {
+      row.push_back("--");
+    }
 
     table.push_back(row);
   }
@@ -238,7 +339,11 @@ int download_asmt(cmdargs &cmd) {
 
   // download files into directory
   Autolab::Attachment handout, writeup;
+  client.begin_batch();
   client.download_handout(handout, new_dir, course_name, asmt_name);
+  client.download_writeup(writeup, new_dir, course_name, asmt_name);
+  client.end_batch();
+
   switch (handout.format) {
     case Autolab::AttachmentFormat::none:
       Logger::info << "Assessment has no handout" << Logger::endl;
@@ -251,7 +356,6 @@ int download_asmt(cmdargs &cmd) {
       break;
   }
 
-  client.download_writeup(writeup, new_dir, course_name, asmt_name);
   switch (writeup.format) {
     case Autolab::AttachmentFormat::none:
       Logger::info << "Assessment has no writeup" << Logger::endl;
@@ -273,6 +377,13 @@ int download_asmt(cmdargs &cmd) {
   return 0;
 }
 
+// the options submit_asmt declares, for completion
+const command_option submit_options[] = {
+  {"-f", "--force", false},
+  {"-w", "--wait", false},
+  {nullptr, nullptr, false},
+};
+
 /* two ways of calling:
  *   1. autolab submit <filename>                  (must have autolab-asmt file)
  *   2. autolab submit <course>:<asmt> <filename>  (from anywhere)
@@ -341,14 +452,16 @@ int submit_asmt(cmdargs &cmd) {
     auto t_now = std::chrono::steady_clock::now();
     auto t_end = t_now + timeout;
     int target_sub_idx = -1;
-    std::vector<Autolab::Submission> subs;
+    Autolab::ScoreMatrix subs;
+    // poll the server, not the cache
+    client.set_cache_bypass(true);
     while (t_now < t_end && !scores_ready) {
       subs.clear();
       client.get_submissions(subs, course_name, asmt_name);
 
       target_sub_idx = -1;
-      for (std::size_t i = 0; i < subs.size(); i++) {
-        if (subs[i].version == version) {
+      for (std::size_t i = 0; i < subs.num_submissions(); i++) {
+        if (subs.version(i) == version) {
           // this is our version
           target_sub_idx = i;
           break;
@@ -360,12 +473,7 @@ int submit_asmt(cmdargs &cmd) {
         return -1;
       }
 
-      for (auto &score : subs[target_sub_idx].scores) {
-        if (!std::isnan(score.second)) {
-          scores_ready = true;
-          break;
-        }
-      }
+      scores_ready = subs.has_released_scores(target_sub_idx);
       if (scores_ready) break;
 
       std::this_thread::sleep_for(wait_per_trial);
@@ -374,13 +482,12 @@ int submit_asmt(cmdargs &cmd) {
 
     if (scores_ready) {
       // found scores
-      std::vector<Autolab::Submission> one_sub = { subs[target_sub_idx] };
       // get problem names
       std::vector<Autolab::Problem> problems;
       client.get_problems(problems, course_name, asmt_name);
       // draw the table
       std::vector<std::vector<std::string>> sub_table;
-      create_scores_table(sub_table, problems, one_sub, 1);
+      create_scores_table(sub_table, problems, subs, target_sub_idx, 1);
       Logger::info << format_table(sub_table);
     } else {
       // time out
@@ -395,6 +502,12 @@ int submit_asmt(cmdargs &cmd) {
   return 0;
 }
 
+// the options show_courses takes, including the hidden one, for completion
+const command_option courses_options[] = {
+  {"-u", "--use-cache", false},
+  {nullptr, nullptr, false},
+};
+
 int show_courses(cmdargs &cmd) {
   cmd.setup_help("autolab courses",
       "List all current courses of the user.");
@@ -406,7 +519,7 @@ int show_courses(cmdargs &cmd) {
     return 0;
   }
 
-  std::vector<Autolab::Course> courses;
+  Autolab::ViewList<Autolab::CourseView> courses;
   client.get_courses(courses);
   LogDebug("Found " << courses.size() << " current courses." << Logger::endl);
 
@@ -415,14 +528,14 @@ int show_courses(cmdargs &cmd) {
   std::string course_name_config_lower = to_lowercase(course_name_config);
 
   for (auto &c : courses) {
-    bool is_curr_asmt = (course_name_config_lower == to_lowercase(c.name));
+    bool is_curr_asmt = (course_name_config_lower == to_lowercase(c.name().str()));
     if (is_curr_asmt) {
       Logger::info << "* " << Logger::GREEN;
     } else {
       Logger::info << "  ";
     }
 
-    Logger::info << c.name << " (" << c.display_name << ")" << Logger::endl;
+    Logger::info << c.name() << " (" << c.display_name() << ")" << Logger::endl;
 
     if (is_curr_asmt) {
       Logger::info << Logger::NONE;
@@ -435,6 +548,19 @@ int show_courses(cmdargs &cmd) {
   return 0;
 }
 
+// the options manage_enrolls declares, for completion
+const command_option enroll_options[] = {
+  {"-u", "--user", true},
+  {"-l", "--lecture", true},
+  {"-s", "--section", true},
+  {"-p", "--grade-policy", true},
+  {"-n", "--nickname", true},
+  {"--set-dropped", nullptr, false},
+  {"-t", "--type", true},
+  {"-v", "--verbose", false},
+  {nullptr, nullptr, false},
+};
+
 // list and CRUD enrollments
 int manage_enrolls(cmdargs &cmd) {
   cmd.setup_help("autolab enroll",
@@ -459,7 +585,28 @@ int manage_enrolls(cmdargs &cmd) {
       "enrollment data after new, edit, or delete");
   cmd.setup_done();
 
-  std::vector<Autolab::Enrollment> enrollments;
+  // rows of the enrollments table, filled in as enrollments are received
+  std::vector<std::vector<std::string>> enrolls_table;
+  auto add_enrollment_row = [&enrolls_table](Autolab::Enrollment &e) {
+    std::vector<std::string> row;
+    row.push_back(e.user.first_name + " " + e.user.last_name);
+    row.push_back(e.user.email);
+    row.push_back(e.lecture);
+    row.push_back(e.section);
+    row.push_back(bool_to_string(e.dropped));
+    row.push_back(Autolab::Utility::authorization_level_to_string(e.auth_level));
+    enrolls_table.push_back(row);
+  };
+  // prepare table header
+  std::vector<std::string> header;
+  header.push_back("name");
+  header.push_back("email");
+  header.push_back("lecture");
+  header.push_back("section");
+  header.push_back("dropped?");
+  header.push_back("type");
+  enrolls_table.push_back(header);
+
   if (cmd.nargs() == 4) {
     std::string action(cmd.args[2]);
     std::string course_name(cmd.args[3]);
@@ -511,47 +658,30 @@ int manage_enrolls(cmdargs &cmd) {
 
     Autolab::Enrollment result;
     client.crud_enrollment(result, course_name, option_user, enroll, crud_action);
-    enrollments.push_back(result);
+    add_enrollment_row(result);
   } else {
     std::string course_name(cmd.args[2]);
-    // list all enrollments
-    client.get_enrollments(enrollments, course_name);
-    LogDebug("Found " << enrollments.size() << " enrollments." << Logger::endl);
+    // list all enrollments, decoding each straight into its table row
+    client.for_each_enrollment(course_name, add_enrollment_row);
+    LogDebug("Found " << enrolls_table.size() - 1 << " enrollments." << Logger::endl);
     // always show output for the list action
     option_verbose = true;
   }
 
   if (option_verbose) {
     // draw table
-    std::vector<std::vector<std::string>> enrolls_table;
-    // prepare table header
-    std::vector<std::string> header;
-    header.push_back("name");
-    header.push_back("email");
-    header.push_back("lecture");
-    header.push_back("section");
-    header.push_back("dropped?");
-    header.push_back("type");
-    enrolls_table.push_back(header);
-
-    // prepare table body
-    for (auto &e : enrollments) {
-      std::vector<std::string> row;
-      row.push_back(e.user.first_name + " " + e.user.last_name);
-      row.push_back(e.user.email);
-      row.push_back(e.lecture);
-      row.push_back(e.section);
-      row.push_back(bool_to_string(e.dropped));
-      row.push_back(Autolab::Utility::authorization_level_to_string(e.auth_level));
-      enrolls_table.push_back(row);
-    }
-
     Logger::info << format_table(enrolls_table);
   }
 
   return 0;
 }
 
+// the options show_assessments takes, including the hidden one, for completion
+const command_option assessments_options[] = {
+  {"-u", "--use-cache", false},
+  {nullptr, nullptr, false},
+};
+
 int show_assessments(cmdargs &cmd) {
   cmd.setup_help("autolab assessments",
       "List all available assessments of a course.");
@@ -566,7 +696,7 @@ int show_assessments(cmdargs &cmd) {
     return 0;
   }
 
-  std::vector<Autolab::Assessment> asmts;
+  Autolab::ViewList<Autolab::AssessmentView> asmts;
   client.get_assessments(asmts, course_name);
   LogDebug("Found " << asmts.size() << " assessments." << Logger::endl);
 
@@ -575,16 +705,16 @@ int show_assessments(cmdargs &cmd) {
   bool is_curr_course = case_insensitive_str_equal(course_name, course_name_config);
   std::string asmt_name_config_lower = to_lowercase(asmt_name_config);
 
-  std::sort(asmts.begin(), asmts.end(), Autolab::Utility::compare_assessments_by_name);
+  std::sort(asmts.begin(), asmts.end(), Autolab::compare_assessment_views_by_name);
   for (auto &a : asmts) {
-    bool is_curr_asmt = is_curr_course && (asmt_name_config_lower == to_lowercase(a.name));
+    bool is_curr_asmt = is_curr_course && (asmt_name_config_lower == to_lowercase(a.name().str()));
     if (is_curr_asmt) {
       Logger::info << "* " << Logger::GREEN;
     } else {
       Logger::info << "  ";
     }
 
-    Logger::info << a.name << " (" << a.display_name << ")" << Logger::endl;
+    Logger::info << a.name() << " (" << a.display_name() << ")" << Logger::endl;
 
     if (is_curr_asmt) {
       Logger::info << Logger::NONE;
@@ -611,27 +741,36 @@ int show_problems(cmdargs &cmd) {
   } else {
     if (!read_asmt_file(course_name, asmt_name)) {
       print_not_in_asmt_dir_error();
-      exit(0);
+      throw command_exit{0};
     }
   }
 
-  std::vector<Autolab::Problem> problems;
+  Autolab::ViewList<Autolab::ProblemView> problems;
   client.get_problems(problems, course_name, asmt_name);
 
   LogDebug("Found " << problems.size() << " problems." << Logger::endl);
 
   for (auto &p : problems) {
-    Logger::info << p.name;
-    if (!std::isnan(p.max_score)) {
-      Logger::info << " (" << p.max_score << ")" << Logger::endl;
+    Logger::info << p.name();
+    if (!std::isnan(p.max_score())) {
+      Logger::info << " (" << p.max_score() << ")" << Logger::endl;
     } else {
       Logger::info << Logger::endl;
     }
   }
 
+  // save to cache as well
+  update_problem_cache_entry(course_name, asmt_name, problems);
+
   return 0;
 }
 
+// the options show_scores declares, for completion
+const command_option scores_options[] = {
+  {"-a", "--all", false},
+  {nullptr, nullptr, false},
+};
+
 int show_scores(cmdargs &cmd) {
   cmd.setup_help("autolab scores",
       "Show all scores the user got for an assessment. Course and assessment "
@@ -648,24 +787,25 @@ int show_scores(cmdargs &cmd) {
   } else {
     if (!read_asmt_file(course_name, asmt_name)) {
       print_not_in_asmt_dir_error();
-      exit(0);
+      throw command_exit{0};
     }
   }
 
+  // get problems and submissions
   std::vector<Autolab::Problem> problems;
+  Autolab::ScoreMatrix subs;
+  client.begin_batch();
   client.get_problems(problems, course_name, asmt_name);
-
-  // get submissions
-  std::vector<Autolab::Submission> subs;
   client.get_submissions(subs, course_name, asmt_name);
-  LogDebug("Found " << subs.size() << " submissions." << Logger::endl);
+  client.end_batch();
+  LogDebug("Found " << subs.num_submissions() << " submissions." << Logger::endl);
 
   Logger::info << "Scores for " << course_name << ":" << asmt_name << Logger::endl
     << Logger::endl;
 
   std::vector<std::vector<std::string>> sub_table;
-  int max_num_rows = option_all ? subs.size() : 1;
-  int num_rows = create_scores_table(sub_table, problems, subs, max_num_rows);
+  int max_num_rows = option_all ? subs.num_submissions() : 1;
+  int num_rows = create_scores_table(sub_table, problems, subs, 0, max_num_rows);
 
   Logger::info << format_table(sub_table);
   if (num_rows == 0) {
@@ -675,6 +815,13 @@ int show_scores(cmdargs &cmd) {
   return 0;
 }
 
+// the options show_feedback declares, for completion
+const command_option feedback_options[] = {
+  {"-p", "--problem", true},
+  {"-v", "--version", true},
+  {nullptr, nullptr, false},
+};
+
 int show_feedback(cmdargs &cmd) {
   cmd.setup_help("autolab feedback",
       "Gets feedback for a problem of an assessment. If version number is not "
@@ -695,17 +842,26 @@ int show_feedback(cmdargs &cmd) {
   } else {
     if (!read_asmt_file(course_name, asmt_name)) {
       print_not_in_asmt_dir_error();
-      exit(0);
+      throw command_exit{0};
     }
   }
 
+  // fetch whatever is needed to fill in the defaults
+  std::vector<Autolab::Submission> subs;
+  std::vector<Autolab::Problem> problems;
+  client.begin_batch();
+  if (option_version.length() == 0) {
+    client.get_submissions(subs, course_name, asmt_name);
+  }
+  if (option_problem.length() == 0) {
+    client.get_problems(problems, course_name, asmt_name);
+  }
+  client.end_batch();
+
   // determine version number
   int version = -1;
   if (option_version.length() == 0) {
     // use latest version
-    std::vector<Autolab::Submission> subs;
-    client.get_submissions(subs, course_name, asmt_name);
-
     if (subs.size() == 0) {
       Logger::fatal << "No submissions available for this assessment." << Logger::endl;
       return 0;
@@ -719,9 +875,6 @@ int show_feedback(cmdargs &cmd) {
   // determine problem name
   if (option_problem.length() == 0) {
     // use first problem
-    std::vector<Autolab::Problem> problems;
-    client.get_problems(problems, course_name, asmt_name);
-
     if (problems.size() == 0) {
       Logger::fatal << "This assessment has no problems." << Logger::endl;
       return 0;
@@ -4,8 +4,16 @@
 #include "autolab/client.h"
 
 #include "cmdargs.h"
+#include "cmdmap.h"
 
 bool init_autolab_client();
+void save_autolab_client_state();
+// Returns true in the parent if a child was started. The parent should then
+// leave with _exit, so that the client's connections, which the child
+// inherited, aren't shut down under it.
+bool revalidate_in_background();
+// same, in the calling process
+void revalidate_stale_responses();
 int perform_device_flow(Autolab::Client &client);
 
 int show_status(cmdargs &cmd);
@@ -19,6 +27,15 @@ int show_scores(cmdargs &cmd);
 int show_feedback(cmdargs &cmd);
 int manage_enrolls(cmdargs &cmd);
 
+// the options of the commands above, see command_info in cmdmap.h. Each is
+// defined next to its command, and must list what the command declares.
+extern const command_option submit_options[];
+extern const command_option courses_options[];
+extern const command_option enroll_options[];
+extern const command_option assessments_options[];
+extern const command_option scores_options[];
+extern const command_option feedback_options[];
+
 /* globals */
 
 extern Autolab::Client client;
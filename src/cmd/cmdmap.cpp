@@ -1,53 +1,62 @@
+#include <string.h>
+
+#include <algorithm>
+
 #include "logger.h"
 
 #include "cmdimp.h"
 #include "cmdmap.h"
 
-int CommandMap::exec_command(cmdargs &cmd, std::string raw_command) {
+// sorted by name
+constexpr command_info autolab_commands[] = {
+  {"assessments", "assessments/asmts   List all assessments of a course",        &show_assessments, false, true,  course_argument,         assessments_options},
+  {"courses",     "courses             List all courses",                        &show_courses,     false, true,  no_arguments,            courses_options},
+  {"download",    "download            Download files needed for an assessment", &download_asmt,    false, false, asmt_argument,           nullptr},
+  {"enroll",      "enroll              Manage users affiliated with a course",   &manage_enrolls,   true,  false, enroll_arguments,        enroll_options},
+  {"feedback",    "feedback            Show feedback on a submission",           &show_feedback,    false, true,  asmt_argument,           feedback_options},
+  {"problems",    "problems            List all problems in an assessment",      &show_problems,    false, true,  asmt_argument,           nullptr},
+  {"scores",      "scores/submissions  Show scores got on an assessment",        &show_scores,      false, true,  asmt_argument,           scores_options},
+  {"status",      "status              Show status of the local assessment",     &show_status,      false, true,  no_arguments,            nullptr},
+  {"submit",      "submit              Submit a file to an assessment",          &submit_asmt,      false, false, asmt_and_file_arguments, submit_options},
+};
+const std::size_t num_autolab_commands =
+  sizeof(autolab_commands) / sizeof(autolab_commands[0]);
+
+constexpr command_alias command_aliases[] = {
+  {"asmts", "assessments"},
+  {"submissions", "scores"},
+};
+const std::size_t num_command_aliases =
+  sizeof(command_aliases) / sizeof(command_aliases[0]);
+
+const command_info *find_autolab_command(const std::string &name) {
+  std::string command_name(name);
+  for (auto &alias : command_aliases) {
+    if (name == alias.alias) command_name = alias.name;
+  }
+
+  const command_info *end = autolab_commands + num_autolab_commands;
+  const command_info *it = std::lower_bound(autolab_commands, end, command_name,
+    [](const command_info &c, const std::string &n) {
+      return strcmp(c.name, n.c_str()) < 0;
+    });
+  if (it == end || command_name != it->name) return nullptr;
+  return it;
+}
+
+int exec_command(cmdargs &cmd, const std::string &command) {
   // Translate to default command name and check if it's valid
-  std::string command = aliases[raw_command];
-  command_info_map::iterator it = info_map.find(command);
-  if(it == info_map.end()) {
-    Logger::fatal << "Unrecognized command: " << raw_command << Logger::endl;
+  const command_info *ci = find_autolab_command(command);
+  if (!ci) {
+    Logger::fatal << "Unrecognized command: " << command << Logger::endl;
     return -1;
   }
 
   // run the command and return its result
-  command_info ci = it->second;
-  return ci.helper_fn(cmd);
+  return ci->helper_fn(cmd);
 }
 
-CommandMap init_autolab_command_map() {
-  command_alias_map aliases;
-  aliases["status"] = "status";
-  aliases["download"] = "download";
-  aliases["submit"] = "submit";
-  aliases["courses"] = "courses";
-  aliases["assessments"] = "assessments";
-  aliases["asmts"] = "assessments";
-  aliases["problems"] = "problems";
-  aliases["scores"] = "scores";
-  aliases["submissions"] = "scores";
-  aliases["feedback"] = "feedback";
-  aliases["enroll"] = "enroll";
-
-  command_info_map info_map {
-    // general commands
-    {"status",     {"status              Show status of the local assessment",     &show_status,      false}},
-    {"download",   {"download            Download files needed for an assessment", &download_asmt,    false}},
-    {"submit",     {"submit              Submit a file to an assessment",          &submit_asmt,      false}},
-    {"courses",    {"courses             List all courses",                        &show_courses,     false}},
-    {"assessments",{"assessments/asmts   List all assessments of a course",        &show_assessments, false}},
-    {"problems",   {"problems            List all problems in an assessment",      &show_problems,    false}},
-    {"scores",     {"scores/submissions  Show scores got on an assessment",        &show_scores,      false}},
-    {"feedback",   {"feedback            Show feedback on a submission",           &show_feedback,    false}},
-    // instructor commands
-    {"enroll",     {"enroll              Manage users affiliated with a course",   &manage_enrolls,   true}}
-  };
-
-  CommandMap command_map = CommandMap();
-  command_map.aliases = aliases;
-  command_map.info_map = info_map;
-
-  return command_map;
+bool is_read_only_command(const std::string &command) {
+  const command_info *ci = find_autolab_command(command);
+  return ci && ci->read_only;
 }
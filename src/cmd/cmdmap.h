@@ -1,54 +1,89 @@
 #ifndef AUTOLAB_CMDMAP_H_
 #define AUTOLAB_CMDMAP_H_
 
+#include <cstddef>
 #include <string>
-#include <vector>
 
 #include "cmdargs.h"
 
 /*
-  The struct that will be stored as values in the info_map
+  What the positional arguments of a command are, for completion
+*/
+enum command_arguments {
+  no_arguments,
+  file_argument,             // filename
+  course_argument,           // course_name
+  asmt_argument,             // course_name:assessment_name
+  asmt_and_file_arguments,   // course_name:assessment_name filename
+  enroll_arguments,          // [action] course_name
+};
+
+/*
+  An option a command declares with new_option or new_flag_option, for
+  completion. Option tables end with an entry whose short_name is nullptr.
+*/
+struct command_option {
+  const char *short_name;
+  const char *long_name; // nullptr if there is none
+  bool takes_value;
+};
+
+/*
+  An entry of the command table
 
   Contains:
+    - The name of the command
     - A string to print in the usage statement
     - A helper function to be called when the subcommand is specified
     - A boolean that specifies if the command is intended for instructors only
+    - A boolean that specifies if the command only reads, from the server and
+      from the local caches. Running such commands more than once, or at the
+      same time as each other, makes no difference to their output.
+    - Its positional arguments and its options (nullptr if it has none), which
+      are completed by the shell
 */
-typedef struct command_info {
-  std::string usage;
+struct command_info {
+  const char *name;
+  const char *usage;
   int (* helper_fn) (cmdargs &cmd);
   bool instructor_command;
-} command_info;
-
-typedef std::map<std::string, command_info> command_info_map;
-typedef std::map<std::string, std::string> command_alias_map;
+  bool read_only;
+  command_arguments arguments;
+  const command_option *options;
+};
 
 /*
-  An object that will keep track of all valid commands and information
-  associated with them.
+  The commands that the Autolab CLI offers, sorted by name. The table is
+  built at compile time, so looking up a command needs no setup at startup.
+*/
+extern const command_info autolab_commands[];
+extern const std::size_t num_autolab_commands;
 
-  Variables:
-    - A dictionary of commands to command_info structs
-    - A dictionary of command aliases to the default command names
+/*
+  Other names the commands can be run by
+*/
+struct command_alias {
+  const char *alias;
+  const char *name;
+};
+extern const command_alias command_aliases[];
+extern const std::size_t num_command_aliases;
 
-  Functions:
-    - exec_command: (string, cmdargs)s -> int
-      - takes a subcommand and executes it
-      - "executes it" by running the helper function specified in its
-        respective command_info struct
+/*
+  Finds a command by its name or one of its aliases. Returns nullptr if there
+  is no such command.
 */
-class CommandMap {
-  public:
-  command_info_map info_map;
-  command_alias_map aliases;
+const command_info *find_autolab_command(const std::string &name);
 
-  int exec_command(cmdargs &cmd, std::string command);
-};
+/*
+  Takes a subcommand and executes it, by running the helper function specified
+  in its command_info. Returns -1 if there is no such command.
+*/
+int exec_command(cmdargs &cmd, const std::string &command);
 
 /*
-  Takes no arguments and spits out the standard command map that the Autolab
-  CLI uses for its operations.
+  Whether the command (or alias) only reads, see command_info.
 */
-CommandMap init_autolab_command_map();
+bool is_read_only_command(const std::string &command);
 
 #endif /* AUTOLAB_CMDMAP_H_ */
@@ -0,0 +1,236 @@
+#include "completion.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "autolab/views.h"
+#include "logger.h"
+
+#include "../cache/cache.h"
+#include "../cache/metadata_cache.h"
+
+#include "cmdmap.h"
+
+const int complete_filename_status = 2;
+
+// every command has a help option, see cmdargs::setup_help
+const command_option help_option = {"-h", "--help", false};
+
+const char *enroll_actions[] = {"drop", "edit", "new"};
+
+bool starts_with(Autolab::StringView s, const std::string &prefix) {
+  return s.length() >= prefix.length() &&
+    memcmp(s.data(), prefix.data(), prefix.length()) == 0;
+}
+
+Autolab::StringView to_view(const std::string &s) {
+  return Autolab::StringView(s.data(), s.length());
+}
+
+// a command from the command table, aliases included, or one of the others
+const command_info *find_command(const std::string &name,
+    const command_info *other_commands, size_t num_other_commands) {
+  const command_info *command = find_autolab_command(name);
+  for (size_t i = 0; !command && i < num_other_commands; i++) {
+    if (name == other_commands[i].name) command = &other_commands[i];
+  }
+  return command;
+}
+
+bool option_matches(const command_option &opt, const std::string &word) {
+  return word == opt.short_name || (opt.long_name && word == opt.long_name);
+}
+
+// whether word is an option of command that is followed by a value
+bool option_takes_value(const command_info &command, const std::string &word) {
+  if (!command.options) return false;
+  for (const command_option *opt = command.options; opt->short_name; opt++) {
+    if (opt->takes_value && option_matches(*opt, word)) return true;
+  }
+  return false;
+}
+
+/* candidates */
+
+void complete_commands(const std::string &prefix,
+    const command_info *other_commands, size_t num_other_commands) {
+  std::vector<const char *> names;
+  for (size_t i = 0; i < num_autolab_commands; i++) {
+    names.push_back(autolab_commands[i].name);
+  }
+  for (size_t i = 0; i < num_command_aliases; i++) {
+    names.push_back(command_aliases[i].alias);
+  }
+  for (size_t i = 0; i < num_other_commands; i++) {
+    names.push_back(other_commands[i].name);
+  }
+  std::sort(names.begin(), names.end(), [](const char *a, const char *b) {
+    return strcmp(a, b) < 0;
+  });
+
+  for (const char *name : names) {
+    if (starts_with(Autolab::StringView(name, strlen(name)), prefix)) {
+      Logger::info << name << "\n";
+    }
+  }
+}
+
+void complete_option(const command_option &opt, const std::string &prefix) {
+  const char *name = opt.long_name ? opt.long_name : opt.short_name;
+  if (starts_with(Autolab::StringView(name, strlen(name)), prefix)) {
+    Logger::info << name << "\n";
+  }
+}
+
+void complete_options(const command_info &command, const std::string &prefix) {
+  complete_option(help_option, prefix);
+  if (!command.options) return;
+  for (const command_option *opt = command.options; opt->short_name; opt++) {
+    complete_option(*opt, prefix);
+  }
+}
+
+// suffix is appended to every course name
+void complete_courses(const metadata_file &cache, const std::string &prefix,
+    const char *suffix) {
+  const metadata_course *begin, *end;
+  cache.find_courses(to_view(prefix), begin, end);
+  for (const metadata_course *c = begin; c != end; c++) {
+    if (!(c->flags & metadata_listed)) continue;
+    Logger::info << cache.string(c->name) << suffix << "\n";
+  }
+}
+
+// word is course_name:partial_assessment_name
+void complete_asmts(const metadata_file &cache, const std::string &word) {
+  size_t colon = word.find(':');
+  std::string course_name = word.substr(0, colon);
+  std::string prefix = word.substr(colon + 1);
+
+  const metadata_course *course = cache.find_course(to_view(course_name));
+  if (!course) return;
+
+  const metadata_asmt *begin, *end;
+  cache.find_asmts(*course, to_view(prefix), begin, end);
+  for (const metadata_asmt *a = begin; a != end; a++) {
+    if (!(a->flags & metadata_listed)) continue;
+    Logger::info << course_name << ":" << cache.string(a->name) << "\n";
+  }
+}
+
+// position is the index of the positional argument being completed, starting
+// at 0, and previous holds the arguments before it.
+int complete_argument(const command_info &command, size_t position,
+    const std::vector<std::string> &previous, const std::string &word) {
+  if (command.arguments == no_arguments) return 0;
+  if (command.arguments == file_argument) {
+    return position == 0 ? complete_filename_status : 0;
+  }
+  if (command.arguments == asmt_and_file_arguments && position == 1) {
+    return complete_filename_status;
+  }
+
+  metadata_file cache;
+  bool has_cache = open_metadata_cache(cache);
+
+  switch (command.arguments) {
+    case course_argument:
+      if (position == 0 && has_cache) complete_courses(cache, word, "");
+      break;
+    case asmt_argument:
+    case asmt_and_file_arguments:
+      if (position != 0 || !has_cache) break;
+      if (word.find(':') == std::string::npos) {
+        complete_courses(cache, word, ":");
+      } else {
+        complete_asmts(cache, word);
+      }
+      break;
+    case enroll_arguments: {
+      bool after_action = position == 1 && std::find(std::begin(enroll_actions),
+        std::end(enroll_actions), previous[0]) != std::end(enroll_actions);
+      if (position == 0) {
+        for (const char *action : enroll_actions) {
+          if (starts_with(Autolab::StringView(action, strlen(action)), word)) {
+            Logger::info << action << "\n";
+          }
+        }
+      }
+      if ((position == 0 || after_action) && has_cache) {
+        complete_courses(cache, word, "");
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return 0;
+}
+
+/* entry point */
+
+int complete_command_line(const std::string &line,
+    const command_info *other_commands, size_t num_other_commands) {
+  // the last word is the one being completed, empty if the line ends with a
+  // space
+  std::vector<std::string> words;
+  size_t pos = 0;
+  while (true) {
+    size_t start = line.find_first_not_of(" \t", pos);
+    if (start == std::string::npos) {
+      words.emplace_back();
+      break;
+    }
+    size_t end = line.find_first_of(" \t", start);
+    words.push_back(line.substr(start, end - start));
+    if (end == std::string::npos) break;
+    pos = end;
+  }
+
+  int status = 0;
+  const std::string &word = words.back();
+  if (words.size() == 1) {
+    // the program name itself
+  } else if (words.size() == 2) {
+    if (word.length() > 0 && word[0] == '-') {
+      for (const char *opt : {"--help", "--version"}) {
+        if (starts_with(Autolab::StringView(opt, strlen(opt)), word)) {
+          Logger::info << opt << "\n";
+        }
+      }
+    } else {
+      complete_commands(word, other_commands, num_other_commands);
+    }
+  } else {
+    const command_info *command = find_command(words[1], other_commands,
+      num_other_commands);
+    if (!command) return 0;
+
+    // collect the positional arguments before the word
+    std::vector<std::string> arguments;
+    for (size_t i = 2; i < words.size() - 1; i++) {
+      if (words[i].length() > 0 && words[i][0] == '-') {
+        if (option_takes_value(*command, words[i])) i++;
+        continue;
+      }
+      arguments.push_back(words[i]);
+    }
+    bool is_value = words.size() > 3 &&
+      option_takes_value(*command, words[words.size() - 2]);
+
+    if (is_value) {
+      // option values can be anything
+    } else if (word.length() > 0 && word[0] == '-') {
+      complete_options(*command, word);
+    } else {
+      status = complete_argument(*command, arguments.size(), arguments, word);
+    }
+  }
+
+  return status;
+}
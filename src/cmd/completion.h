@@ -0,0 +1,26 @@
+#ifndef AUTOLAB_COMPLETION_H_
+#define AUTOLAB_COMPLETION_H_
+
+#include <cstddef>
+#include <string>
+
+#include "cmdmap.h"
+
+/*
+  Implements the hidden '__complete' command used by autocomplete/autolab.
+
+  Takes the command line up to the cursor and prints the possible completions
+  of its last word, one per line. Course and assessment names come from the
+  metadata cache only, so no credentials are loaded and no request is made.
+
+  The commands, their arguments and their options come from the command
+  table (see cmdmap.h), and from other_commands for the commands that aren't
+  in it.
+
+  Returns the exit status: 0 normally, or 2 if the word is a filename that the
+  shell should complete itself.
+*/
+int complete_command_line(const std::string &line,
+  const command_info *other_commands, std::size_t num_other_commands);
+
+#endif /* AUTOLAB_COMPLETION_H_ */
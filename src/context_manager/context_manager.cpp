@@ -1,5 +1,14 @@
 #include "context_manager.h"
 
+#include <errno.h>
+#include <fcntl.h>    // open
+#include <sys/file.h> // flock
+#include <sys/stat.h> // stat
+#include <unistd.h>   // close
+
+#include <atomic>
+#include <cstdlib>
+
 #include "../app_credentials.h"
 #include "../file/file_utils.h"
 #include "logger.h"
@@ -8,14 +17,19 @@
 #define TOKEN_CACHE_FILE_MAXSIZE 256
 
 const std::string token_cache_filename = ".arcache";
+const std::string token_lock_filename = ".arcache.lock";
 const std::string cred_dirname = ".autolab";
 
-std::string token_pair_to_string(std::string at, std::string rt) {
-  std::string pre_crypt = at + "\n" + rt;
+// the tokens, and when the access token expires, one per line. Files written
+// before the expiry was kept have no third line.
+std::string token_pair_to_string(std::string at, std::string rt, std::time_t expires_at) {
+  std::string pre_crypt = at + "\n" + rt + "\n" + std::to_string((long long)expires_at);
   return encrypt_string(pre_crypt, crypto_key, crypto_iv);
 }
 
-bool token_pair_from_string(char *raw_src, size_t raw_len, std::string &at, std::string &rt) {
+bool token_pair_from_string(char *raw_src, size_t raw_len, std::string &at, std::string &rt,
+  std::time_t &expires_at)
+{
   std::string src = decrypt_string(raw_src, raw_len, crypto_key, crypto_iv);
 
   std::string::size_type split_pos_1 = src.find('\n');
@@ -24,6 +38,10 @@ bool token_pair_from_string(char *raw_src, size_t raw_len, std::string &at, std:
 
   at.assign(src, 0, split_pos_1);
   rt.assign(src, split_pos_1+1, split_pos_2 - split_pos_1 - 1);
+  expires_at = 0;
+  if (split_pos_2 != std::string::npos) {
+    expires_at = std::strtoll(src.c_str() + split_pos_2 + 1, nullptr, 10);
+  }
   return true;
 }
 
@@ -67,32 +85,92 @@ bool token_cache_file_exists() {
                   token_cache_filename.c_str());
 }
 
+/* token cache locking
+ *
+ * Several autolab processes may use the tokens at once. The token cache is
+ * replaced by renaming a new file over it, so the advisory lock is taken on a
+ * separate lock file next to it: shared while reading, exclusive while
+ * writing, and exclusive for the whole of a token refresh (see
+ * lock_token_cache).
+ */
+
+// the lock held by lock_token_cache, -1 if none
+std::atomic<int> token_lock_fd(-1);
+
+int lock_token_file(int operation) {
+  std::string path = get_cred_dir_full_path() + "/" + token_lock_filename;
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (fd < 0) return -1;
+  while (flock(fd, operation) < 0) {
+    if (errno == EINTR) continue;
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Holds the lock while in scope, unless this process holds it already for a
+// refresh. Without the lock file (e.g. a read-only home directory), the token
+// cache is used without locking, as before.
+struct token_file_lock {
+  int fd;
+  explicit token_file_lock(int operation) : fd(-1) {
+    if (token_lock_fd < 0) fd = lock_token_file(operation);
+  }
+  ~token_file_lock() {
+    if (fd >= 0) close(fd); // releases the lock
+  }
+};
+
 /* interface */
-void store_tokens(std::string at, std::string rt) {
+void store_tokens(std::string at, std::string rt, std::time_t expires_at) {
   check_and_create_token_directory();
-  std::string token_pair = token_pair_to_string(at, rt);
+  std::string token_pair = token_pair_to_string(at, rt, expires_at);
 
-  write_file(get_token_cache_file_full_path().c_str(),
-             token_pair.c_str(), token_pair.length());
+  token_file_lock lock(LOCK_EX);
+  write_file_atomic(get_token_cache_file_full_path().c_str(),
+                    token_pair.c_str(), token_pair.length());
   LogDebug("[ContextManager] tokens stored" << Logger::endl);
 }
 
 // returns true if got token, false if failed to get token.
 // Failure likely because token cache file doesn't exist.
-bool load_tokens(std::string &at, std::string &rt) {
+bool load_tokens(std::string &at, std::string &rt, std::time_t &expires_at) {
   if (!check_and_create_token_directory()) return false;
   if (!token_cache_file_exists()) return false;
 
   char raw_result[TOKEN_CACHE_FILE_MAXSIZE];
-  size_t num_read = read_file(get_token_cache_file_full_path().c_str(),
-            raw_result, TOKEN_CACHE_FILE_MAXSIZE);
+  size_t num_read;
+  {
+    // waits for a refresh in another process to store its tokens
+    token_file_lock lock(LOCK_SH);
+    num_read = read_file(get_token_cache_file_full_path().c_str(),
+              raw_result, TOKEN_CACHE_FILE_MAXSIZE);
+  }
   LogDebug("read size " << num_read << "\n");
 
-  if (!token_pair_from_string(raw_result, num_read, at, rt)) return false;
+  if (!token_pair_from_string(raw_result, num_read, at, rt, expires_at)) return false;
   LogDebug("[ContextManager] tokens loaded" << Logger::endl);
   return true;
 }
 
+void lock_token_cache() {
+  if (token_lock_fd >= 0) return;
+  check_and_create_token_directory();
+  token_lock_fd = lock_token_file(LOCK_EX);
+  LogDebug("[ContextManager] token cache locked for refresh" << Logger::endl);
+}
+
+void unlock_token_cache() {
+  int fd = token_lock_fd.exchange(-1);
+  if (fd >= 0) close(fd);
+}
+
+std::time_t tokens_last_modified() {
+  struct stat info;
+  if (stat(get_token_cache_file_full_path().c_str(), &info) < 0) return 0;
+  return info.st_mtime;
+}
 
 /************* asmt *************/
 #define ASMT_FILE_MAXSIZE 128
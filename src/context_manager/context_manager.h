@@ -8,16 +8,28 @@
 #ifndef AUTOLAB_CONTEXT_MANAGER_H_
 #define AUTOLAB_CONTEXT_MANAGER_H_
 
+#include <ctime>
 #include <string>
 
 std::string get_cred_dir_full_path();
 bool check_and_create_token_directory();
 
-// read tokens from file. If nonexistent, return false.
-bool load_tokens(std::string &at, std::string &rt);
+// read tokens from file. If nonexistent, return false. expires_at is when the
+// access token expires, 0 if unknown.
+bool load_tokens(std::string &at, std::string &rt, std::time_t &expires_at);
 
-// store tokens to file.
-void store_tokens(std::string at, std::string rt);
+// store tokens to file, replacing it atomically.
+void store_tokens(std::string at, std::string rt, std::time_t expires_at);
+
+// Hold an exclusive lock on the tokens file across a token refresh, from
+// reading the current tokens to storing the new ones, so that processes
+// refresh one at a time. load_tokens and store_tokens in this process don't
+// wait for it while it is held.
+void lock_token_cache();
+void unlock_token_cache();
+
+// modification time of the tokens file, 0 if there is none.
+std::time_t tokens_last_modified();
 
 bool read_asmt_file(std::string &course_name, std::string &asmt_name);
 void write_asmt_file(std::string filename, std::string course_name, std::string asmt_name);
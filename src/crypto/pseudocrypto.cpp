@@ -2,6 +2,7 @@
 
 #include <cstring>
 
+#include <memory>
 #include <string>
 
 #include <openssl/err.h>
@@ -9,22 +10,32 @@
 
 #include "logger.h"
 
+#include "../cmd/cmdargs.h"
+
 #define MAX_CIPHERTEXT_LEN 256
 
+// freed however the function using it returns
+typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> cipher_ctx_ptr;
+
+// stops the command, see exit_with_errno in file_utils.cpp
 void exit_with_crypto_error() {
   Logger::fatal << "OpenSSL error" << Logger::endl;
-  ERR_print_errors_fp(stderr);
-  exit(-1);
+  char message[256];
+  for (unsigned long e = ERR_get_error(); e != 0; e = ERR_get_error()) {
+    ERR_error_string_n(e, message, sizeof(message));
+    Logger::fatal << message << Logger::endl;
+  }
+  throw command_exit{-1};
 }
 
 void check_key_and_iv_lengths(unsigned char *key, unsigned char *iv) {
   if (strnlen((char *)key, key_length_in_chars + 1) != key_length_in_chars) {
     Logger::fatal << "[Pseudocrypto] key length error" << Logger::endl;
-    exit(-1);
+    throw command_exit{-1};
   }
   if (strnlen((char *)iv, iv_length_in_chars + 1) != iv_length_in_chars) {
     Logger::fatal << "[Pseudocrypto] iv length error" << Logger::endl;
-    exit(-1);
+    throw command_exit{-1};
   }
 }
 
@@ -32,7 +43,6 @@ std::string encrypt_string(std::string srctext, unsigned char *key,
     unsigned char *iv) {
   check_key_and_iv_lengths(key, iv);
 
-  EVP_CIPHER_CTX *ctx;
   unsigned char ciphertext[MAX_CIPHERTEXT_LEN];
   int total_len = 0;
   int temp_len = 0;
@@ -41,22 +51,21 @@ std::string encrypt_string(std::string srctext, unsigned char *key,
   int input_len = srctext.length();
 
   // create context
-  if (!(ctx = EVP_CIPHER_CTX_new()))
+  cipher_ctx_ptr ctx(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+  if (!ctx)
     exit_with_crypto_error();
 
-  if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv))
+  if (1 != EVP_EncryptInit_ex(ctx.get(), EVP_aes_256_cbc(), NULL, key, iv))
     exit_with_crypto_error();
 
-  if (1 != EVP_EncryptUpdate(ctx, ciphertext, &temp_len, plaintext, input_len))
+  if (1 != EVP_EncryptUpdate(ctx.get(), ciphertext, &temp_len, plaintext, input_len))
     exit_with_crypto_error();
   total_len = temp_len;
 
-  if (1 != EVP_EncryptFinal_ex(ctx, ciphertext + temp_len, &temp_len))
+  if (1 != EVP_EncryptFinal_ex(ctx.get(), ciphertext + temp_len, &temp_len))
     exit_with_crypto_error();
   total_len += temp_len;
 
-  EVP_CIPHER_CTX_free(ctx);
-
   // using std::string with arbitrary bytes is technically allowed
   return std::string((char *)ciphertext, total_len);
 }
@@ -65,7 +74,6 @@ std::string decrypt_string(char *srctext, size_t srclength, unsigned char *key,
     unsigned char *iv) {
   check_key_and_iv_lengths(key, iv);
 
-  EVP_CIPHER_CTX *ctx;
   unsigned char plaintext[MAX_CIPHERTEXT_LEN];
   int total_len = 0;
   int temp_len = 0;
@@ -73,21 +81,20 @@ std::string decrypt_string(char *srctext, size_t srclength, unsigned char *key,
   unsigned char *ciphertext = (unsigned char *)srctext;
   int input_len = (int)srclength;
 
-  if (!(ctx = EVP_CIPHER_CTX_new()))
+  cipher_ctx_ptr ctx(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+  if (!ctx)
     exit_with_crypto_error();
 
-  if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv))
+  if (1 != EVP_DecryptInit_ex(ctx.get(), EVP_aes_256_cbc(), NULL, key, iv))
     exit_with_crypto_error();
 
-  if (1 != EVP_DecryptUpdate(ctx, plaintext, &temp_len, ciphertext, input_len))
+  if (1 != EVP_DecryptUpdate(ctx.get(), plaintext, &temp_len, ciphertext, input_len))
     exit_with_crypto_error();
   total_len = temp_len;
 
-  if (1 != EVP_DecryptFinal_ex(ctx, plaintext + temp_len, &temp_len))
+  if (1 != EVP_DecryptFinal_ex(ctx.get(), plaintext + temp_len, &temp_len))
     exit_with_crypto_error();
   total_len += temp_len;
 
-  EVP_CIPHER_CTX_free(ctx);
-
   return std::string((char *)plaintext, total_len);
 }
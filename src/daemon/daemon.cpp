@@ -0,0 +1,398 @@
+#include "daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>      // fcntl
+#include <poll.h>       // poll
+#include <signal.h>     // sigaction
+#include <stdlib.h>     // getenv
+#include <string.h>
+#include <sys/socket.h> // socket, bind, listen, accept, connect
+#include <sys/stat.h>   // umask
+#include <sys/time.h>   // timeval
+#include <sys/un.h>     // sockaddr_un
+#include <unistd.h>     // read, close, unlink
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+#include "../cmd/cmdimp.h"
+#include "../cmd/cmdmap.h"
+#include "../context_manager/context_manager.h"
+#include "../file/file_utils.h"
+
+const std::string daemon_socket_filename = "daemon.sock";
+
+std::string get_daemon_socket_path() {
+  std::string daemon_socket_path = get_cred_dir_full_path();
+  daemon_socket_path.append("/");
+  daemon_socket_path.append(daemon_socket_filename);
+  return daemon_socket_path;
+}
+
+/* wire format
+ *
+ * A request is its length as a uint32_t, followed by the working directory
+ * and the arguments after the program name, each terminated by '\0'.
+ *
+ * The response is a sequence of frames, each a type byte, the length of its
+ * data as a uint32_t, and the data. 'o' and 'e' frames hold output for stdout
+ * and stderr. The last frame is an 'x' frame holding the exit status in
+ * decimal.
+ *
+ * Both ends are on the same machine, so lengths are in host byte order.
+ */
+const uint32_t max_request_length = 1 << 16;
+const size_t frame_header_length = 1 + sizeof(uint32_t);
+const char frame_stdout = 'o';
+const char frame_stderr = 'e';
+const char frame_exit = 'x';
+
+// a client taking longer than this to send its request is dropped
+const long request_timeout_seconds = 5;
+
+// stale responses are revalidated once no command has arrived for this long,
+// so commands sent one after another aren't kept waiting behind it
+const int revalidate_idle_milliseconds = 500;
+
+bool read_fully(int fd, char *data, size_t length) {
+  while (length > 0) {
+    ssize_t amount = read(fd, data, length);
+    if (amount < 0 && errno == EINTR) continue;
+    if (amount <= 0) return false;
+    data += amount;
+    length -= amount;
+  }
+  return true;
+}
+
+// MSG_NOSIGNAL: a peer that went away is an error, not a SIGPIPE
+bool send_fully(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+bool send_frame(int fd, char type, const char *data, size_t length) {
+  char header[frame_header_length];
+  uint32_t data_length = length;
+  header[0] = type;
+  memcpy(header + 1, &data_length, sizeof(data_length));
+  return send_fully(fd, header, sizeof(header)) && send_fully(fd, data, length);
+}
+
+bool make_socket_address(const std::string &path, struct sockaddr_un &addr) {
+  if (path.length() >= sizeof(addr.sun_path)) return false;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.length());
+  return true;
+}
+
+// returns the connected socket, or -1 if no daemon is listening
+int connect_to_daemon(const std::string &path) {
+  struct sockaddr_un addr;
+  if (!make_socket_address(path, addr)) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* client side */
+
+bool forward_to_daemon(int argc, char *argv[], int &status) {
+  if (getenv("AUTOLAB_NO_DAEMON")) return false;
+
+  int fd = connect_to_daemon(get_daemon_socket_path());
+  if (fd < 0) return false;
+
+  std::string request(get_curr_dir());
+  request.push_back('\0');
+  for (int i = 1; i < argc; i++) {
+    request.append(argv[i]);
+    request.push_back('\0');
+  }
+  uint32_t request_length = request.length();
+  if (request_length > max_request_length ||
+      !send_fully(fd, (const char *)&request_length, sizeof(request_length)) ||
+      !send_fully(fd, request.data(), request.length())) {
+    // the daemon only runs complete requests
+    close(fd);
+    return false;
+  }
+  LogDebug("[Daemon] command forwarded" << Logger::endl);
+
+  char header[frame_header_length];
+  std::string data;
+  while (read_fully(fd, header, sizeof(header))) {
+    uint32_t data_length;
+    memcpy(&data_length, header + 1, sizeof(data_length));
+    data.resize(data_length);
+    if (data_length > 0 && !read_fully(fd, &data[0], data_length)) break;
+
+    if (header[0] == frame_stdout) {
+      std::cout.write(data.data(), data.length());
+      std::cout.flush();
+    } else if (header[0] == frame_stderr) {
+      std::cerr.write(data.data(), data.length());
+      std::cerr.flush();
+    } else if (header[0] == frame_exit) {
+      close(fd);
+      status = atoi(data.c_str());
+      return true;
+    }
+  }
+
+  // the command may or may not have run, so it isn't run again here
+  close(fd);
+  Logger::fatal << "Lost the connection to the autolab daemon." << Logger::endl;
+  status = -1;
+  return true;
+}
+
+/* server side */
+
+volatile sig_atomic_t daemon_stopping = 0;
+
+void stop_daemon(int) {
+  daemon_stopping = 1;
+}
+
+// a command line waiting to be run, and the connections waiting for its output
+struct pending_command {
+  std::string cwd;
+  std::vector<std::string> args;
+  std::vector<int> clients;
+};
+
+bool is_shareable(const pending_command &command) {
+  return is_read_only_command(command.args[0]);
+}
+
+// Sends what is written to it to every client still connected. Sent at each
+// Logger::endl (which flushes), so progress reaches the clients as it happens.
+class client_streambuf : public std::streambuf {
+public:
+  client_streambuf(std::vector<int> &c, char t) : clients(c), type(t) {}
+
+protected:
+  int overflow(int c) override {
+    if (c != traits_type::eof()) buffer.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    buffer.append(s, n);
+    return n;
+  }
+
+  int sync() override {
+    if (buffer.empty()) return 0;
+    for (int &fd : clients) {
+      if (fd >= 0 && !send_frame(fd, type, buffer.data(), buffer.length())) {
+        close(fd); // gone, the command goes on for the others
+        fd = -1;
+      }
+    }
+    buffer.clear();
+    return 0;
+  }
+
+private:
+  std::vector<int> &clients;
+  char type;
+  std::string buffer;
+};
+
+// Reads the request of a new connection. Returns false if there is none.
+bool read_request(int fd, pending_command &command) {
+  struct timeval timeout = {request_timeout_seconds, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  uint32_t request_length;
+  if (!read_fully(fd, (char *)&request_length, sizeof(request_length)) ||
+      request_length == 0 || request_length > max_request_length) {
+    return false;
+  }
+  std::string request(request_length, '\0');
+  if (!read_fully(fd, &request[0], request_length) ||
+      request.back() != '\0') {
+    return false;
+  }
+
+  std::vector<std::string> fields;
+  for (size_t start = 0; start < request.length(); ) {
+    size_t end = request.find('\0', start);
+    fields.push_back(request.substr(start, end - start));
+    start = end + 1;
+  }
+  if (fields.size() < 2) return false;
+
+  command.cwd = fields[0];
+  command.args.assign(fields.begin() + 1, fields.end());
+  return true;
+}
+
+// Accepts every connection waiting, merging identical shareable commands.
+void accept_commands(int listen_fd, std::vector<pending_command> &pending) {
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      return; // EAGAIN: no more waiting
+    }
+    // accepted sockets don't inherit O_NONBLOCK on Linux, but do elsewhere
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    pending_command command;
+    if (!read_request(fd, command)) {
+      close(fd);
+      continue;
+    }
+
+    bool merged = false;
+    if (is_shareable(command)) {
+      for (auto &other : pending) {
+        if (other.cwd == command.cwd && other.args == command.args) {
+          LogDebug("[Daemon] sharing the output of " << command.args[0] << Logger::endl);
+          other.clients.push_back(fd);
+          merged = true;
+          break;
+        }
+      }
+    }
+    if (!merged) {
+      command.clients.push_back(fd);
+      pending.push_back(std::move(command));
+    }
+  }
+}
+
+void run_command(pending_command &command, int (*execute)(int argc, char *argv[])) {
+  client_streambuf out(command.clients, frame_stdout);
+  client_streambuf err(command.clients, frame_stderr);
+  std::streambuf *old_out = std::cout.rdbuf(&out);
+  std::streambuf *old_err = std::cerr.rdbuf(&err);
+  Logger::fatal.reset();
+
+  int status = -1;
+  if (!change_curr_dir(command.cwd.c_str())) {
+    Logger::fatal << "Cannot enter the directory " << command.cwd << ": "
+      << strerror(errno) << Logger::endl;
+  } else {
+    char program_name[] = "autolab";
+    std::vector<char *> argv;
+    argv.push_back(program_name);
+    for (auto &arg : command.args) {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    try {
+      status = execute(argv.size() - 1, argv.data());
+    } catch (std::exception &e) {
+      Logger::fatal << e.what() << Logger::endl;
+    }
+  }
+
+  std::cout.flush();
+  std::cerr.flush();
+  std::cout.rdbuf(old_out);
+  std::cerr.rdbuf(old_err);
+
+  std::string exit_status = std::to_string(status);
+  for (int fd : command.clients) {
+    if (fd < 0) continue;
+    send_frame(fd, frame_exit, exit_status.data(), exit_status.length());
+    close(fd);
+  }
+}
+
+int run_daemon(int (*execute)(int argc, char *argv[])) {
+  check_and_create_token_directory();
+  std::string path = get_daemon_socket_path();
+
+  int other = connect_to_daemon(path);
+  if (other >= 0) {
+    close(other);
+    Logger::fatal << "An autolab daemon is already running." << Logger::endl;
+    return -1;
+  }
+
+  struct sockaddr_un addr;
+  if (!make_socket_address(path, addr)) {
+    Logger::fatal << "Socket path too long: " << path << Logger::endl;
+    return -1;
+  }
+  unlink(path.c_str()); // left behind by a daemon that didn't stop cleanly
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    Logger::fatal << "Failed to create socket: " << strerror(errno) << Logger::endl;
+    return -1;
+  }
+  // only the user may connect
+  mode_t old_mask = umask(0077);
+  int res = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+  umask(old_mask);
+  if (res < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+    Logger::fatal << "Failed to listen on " << path << ": " << strerror(errno) << Logger::endl;
+    close(listen_fd);
+    return -1;
+  }
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop_daemon; // without SA_RESTART, so poll returns
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  Logger::info << "autolab daemon listening on " << path << Logger::endl;
+
+  bool revalidation_due = false;
+  while (!daemon_stopping) {
+    struct pollfd listener = {listen_fd, POLLIN, 0};
+    int ready = poll(&listener, 1, revalidation_due ? revalidate_idle_milliseconds : -1);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      Logger::fatal << "poll failed: " << strerror(errno) << Logger::endl;
+      break;
+    }
+    if (ready == 0) {
+      // idle: nobody is waiting for these
+      revalidate_stale_responses();
+      revalidation_due = false;
+      continue;
+    }
+
+    // requests that arrived while the last commands ran are accepted together
+    std::vector<pending_command> pending;
+    accept_commands(listen_fd, pending);
+    for (auto &command : pending) {
+      run_command(command, execute);
+    }
+    if (!pending.empty()) revalidation_due = true;
+  }
+
+  close(listen_fd);
+  unlink(path.c_str());
+  Logger::info << "autolab daemon stopped" << Logger::endl;
+  return 0;
+}
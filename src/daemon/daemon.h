@@ -0,0 +1,28 @@
+/*
+ * Optional long-lived process ('autolab daemon') that runs commands on behalf
+ * of the CLI.
+ *
+ * The daemon keeps one client alive across commands, along with its tokens,
+ * open connections and caches. It listens on a Unix socket in the user's
+ * credentials directory. While it runs, the CLI sends it the command line and
+ * working directory and prints the output it sends back. When it is not
+ * running, the CLI runs the command itself.
+ *
+ * Commands are run one at a time. Identical read-only commands (same
+ * arguments, same directory) that are waiting at the same time are run once,
+ * and their output is sent to every caller.
+ */
+
+#ifndef AUTOLAB_DAEMON_H_
+#define AUTOLAB_DAEMON_H_
+
+// Serves commands until interrupted. execute runs one command line and returns
+// its exit status. Returns the exit status of the daemon.
+int run_daemon(int (*execute)(int argc, char *argv[]));
+
+// Runs the command line in the daemon if one is listening, setting status to
+// its exit status. Returns false if there is none, and the command is yet to
+// be run.
+bool forward_to_daemon(int argc, char *argv[], int &status);
+
+#endif /* AUTOLAB_DAEMON_H_ */
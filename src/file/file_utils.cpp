@@ -4,20 +4,26 @@
 #include <errno.h>
 #include <fcntl.h>    // open
 #include <pwd.h>      // getpwuid
-#include <stdlib.h>
+#include <stdio.h>    // rename
+#include <stdlib.h>   // getenv, mkostemp
 #include <string.h>
 #include <sys/stat.h> // mkdir, stat
-#include <unistd.h>   // close, write
+#include <unistd.h>   // chdir, close, write
+
+#include <string>
 
 #include "logger.h"
 
+#include "../cmd/cmdargs.h"
+
 const char *home_directory = NULL;
 char curr_directory[MAX_DIR_LENGTH];
 
-// internal error reporting helper
+// internal error reporting helper. Stops the command rather than the process,
+// which may be a daemon or a batch with other commands to run.
 void exit_with_errno() {
   Logger::fatal << strerror(errno) << Logger::endl;
-  exit(-1);
+  throw command_exit{-1};
 }
 
 // checks if file exists. Does not allow directories.
@@ -151,6 +157,40 @@ void write_file(const char *filename, const char *data, size_t length) {
   close(fd);
 }
 
+// writes the whole file under a temporary name in the same directory, then
+// renames it into place, so readers see either the old or the new file.
+void write_file_atomic(const char *filename, const char *data, size_t length) {
+  std::string temp_name(filename);
+  temp_name.append(".XXXXXX");
+
+  // not inherited by the process that revalidates in the background
+  int fd = mkostemp(&temp_name[0], O_CLOEXEC);
+  if (fd < 0) exit_with_errno();
+
+  size_t remaining = length;
+  size_t total_written = 0;
+  while (remaining > 0) {
+    ssize_t amount = TEMP_FAILURE_RETRY(write(fd, data + total_written, remaining));
+    if (amount < 0) {
+      int error = errno;
+      close(fd);
+      unlink(temp_name.c_str());
+      errno = error;
+      exit_with_errno();
+    }
+    // amount is non-negative
+    remaining -= (size_t)amount;
+    total_written += (size_t)amount;
+  }
+
+  if (fsync(fd) < 0 || close(fd) < 0 || rename(temp_name.c_str(), filename) < 0) {
+    int error = errno;
+    unlink(temp_name.c_str());
+    errno = error;
+    exit_with_errno();
+  }
+}
+
 const char *get_home_dir() {
   if (home_directory) return home_directory;
 
@@ -169,3 +209,9 @@ const char *get_curr_dir() {
   if (!res) exit_with_errno();
   return curr_directory;
 }
+
+bool change_curr_dir(const char *dirname) {
+  if (chdir(dirname) < 0) return false;
+  curr_directory[0] = '\0';
+  return true;
+}
@@ -26,8 +26,12 @@ bool recur_find(char *result, const char *dirstart, const char *targetname,
 void create_dir(const char *dirname);
 size_t read_file(const char *filename, char *result, size_t max_length);
 void write_file(const char *filename, const char *data, size_t length);
+// same as write_file, but concurrent readers never see a partially written file
+void write_file_atomic(const char *filename, const char *data, size_t length);
 
 const char *get_home_dir();
 const char *get_curr_dir();
+// returns false if dirname can't be entered
+bool change_curr_dir(const char *dirname);
 
 #endif /* AUTOLAB_FILE_UTILS_H_ */
@@ -1,4 +1,9 @@
+#include <unistd.h> // _exit
+
+#include <cstdlib>
+#include <fstream>
 #include <iomanip>
+#include <iostream>
 #include <string>
 
 #include "autolab/autolab.h"
@@ -6,15 +11,17 @@
 #include "logger.h"
 
 #include "app_credentials.h"
+#include "batch/batch.h"
 #include "build_config.h"
+#include "cache/cache.h"
 #include "cmd/cmdargs.h"
 #include "cmd/cmdimp.h"
 #include "cmd/cmdmap.h"
+#include "cmd/completion.h"
+#include "daemon/daemon.h"
 
 extern Autolab::Client client;
 
-CommandMap command_map;
-
 /* help texts */
 void print_help() {
   Logger::info << "usage: autolab [OPTIONS] <command> [command-args] [command-opts]" << Logger::endl
@@ -22,8 +29,8 @@ void print_help() {
     << "general commands:" << Logger::endl;
 
   // First we print the general-use commands
-  for (auto const &i : command_map.info_map) {
-    command_info ci = i.second;
+  for (std::size_t i = 0; i < num_autolab_commands; i++) {
+    const command_info &ci = autolab_commands[i];
     if(ci.instructor_command == false) {
       Logger::info << ci.usage << Logger::endl;
     }
@@ -33,8 +40,8 @@ void print_help() {
   Logger::info << Logger::endl
     << "instructor commands:" << Logger::endl;
 
-  for (auto const &i : command_map.info_map) {
-    command_info ci = i.second;
+  for (std::size_t i = 0; i < num_autolab_commands; i++) {
+    const command_info &ci = autolab_commands[i];
     if(ci.instructor_command == true) {
       Logger::info << ci.usage << Logger::endl;
     }
@@ -60,6 +67,12 @@ void print_version() {
     << "Target server: " << server_domain << Logger::endl;
 }
 
+// the options user_setup declares, for completion
+const command_option setup_options[] = {
+  {"-f", "--force", false},
+  {nullptr, nullptr, false},
+};
+
 /* must manually init client */
 int user_setup(cmdargs &cmd) {
   cmd.setup_help("autolab setup",
@@ -72,7 +85,8 @@ int user_setup(cmdargs &cmd) {
     bool user_exists = init_autolab_client();
 
     if (user_exists) {
-      // perform a check if not a forced setup
+      // perform a check if not a forced setup, with the server itself
+      client.set_cache_bypass(true);
       bool token_valid = true;
       Autolab::User user_info;
       try {
@@ -106,6 +120,8 @@ int user_setup(cmdargs &cmd) {
   // user non-existant, or existing user's credentials no longer work, or forced
   int result = perform_device_flow(client);
   if (result == 0) {
+    // responses cached for the previous user
+    clear_response_cache();
     Logger::info << Logger::endl << "User setup complete." << Logger::endl;
     return 0;
   }
@@ -113,9 +129,117 @@ int user_setup(cmdargs &cmd) {
   return -1;
 }
 
-int main(int argc, char *argv[]) {
-  command_map = init_autolab_command_map();
+int run_command_line(int argc, char *argv[]);
+const command_info *find_main_command(const std::string &name);
+
+// runs the command lines of the daemon and of batches
+int run_inner_command_line(int argc, char *argv[]) {
+  std::string command(argv[1]);
+  if (find_main_command(command)) {
+    Logger::fatal << "'" << command << "' can't be run from another command." << Logger::endl;
+    return -1;
+  }
+  // options set by the previous command
+  client.set_cache_bypass(false);
+  return run_command_line(argc, argv);
+}
+
+int start_daemon(cmdargs &cmd) {
+  cmd.setup_help("autolab daemon",
+      "Run in the foreground, serving the commands run by the current user. "
+      "While it runs, other autolab commands are forwarded to it and reuse its "
+      "connections and loaded credentials. Stop it with Ctrl-C.");
+  cmd.setup_done();
+
+  if (!init_autolab_client()) {
+    Logger::fatal << "No user set up on this client yet." << Logger::endl
+      << Logger::endl
+      << "Please run 'autolab setup' to setup your Autolab account." << Logger::endl;
+    return 0;
+  }
+  return run_daemon(run_inner_command_line);
+}
 
+// the options start_batch declares, for completion
+const command_option batch_options[] = {
+  {"-j", "--jobs", true},
+  {nullptr, nullptr, false},
+};
+
+int start_batch(cmdargs &cmd) {
+  cmd.setup_help("autolab batch",
+      "Run the commands in a file, one per line, as they would be typed after "
+      "'autolab'. Credentials are loaded once for all of them, and consecutive "
+      "read-only commands run in parallel. Reads from stdin if no file is given.");
+  cmd.new_arg("filename", false);
+  std::string option_jobs = cmd.new_option("-j", "--jobs", "count",
+      "Number of commands to run at once (default 4)");
+  cmd.setup_done();
+
+  unsigned jobs = 4;
+  if (option_jobs.length() > 0) {
+    int value = atoi(option_jobs.c_str());
+    if (value < 1) {
+      Logger::fatal << "Invalid number of jobs: " << option_jobs << Logger::endl;
+      return -1;
+    }
+    jobs = value;
+  }
+
+  if (!init_autolab_client()) {
+    Logger::fatal << "No user set up on this client yet." << Logger::endl
+      << Logger::endl
+      << "Please run 'autolab setup' to setup your Autolab account." << Logger::endl;
+    return 0;
+  }
+
+  if (cmd.nargs() < 3 || cmd.args[2] == "-") {
+    return run_batch(std::cin, jobs, run_inner_command_line);
+  }
+  std::ifstream batch_file(cmd.args[2].c_str());
+  if (!batch_file) {
+    Logger::fatal << "Cannot open " << cmd.args[2] << Logger::endl;
+    return -1;
+  }
+  return run_batch(batch_file, jobs, run_inner_command_line);
+}
+
+// The commands run by main itself instead of from the command table. They
+// set up the client in their own way, and can't be run by a daemon or from a
+// batch.
+const command_info main_commands[] = {
+  {"batch",  "", &start_batch,  false, false, file_argument, batch_options},
+  {"daemon", "", &start_daemon, false, false, no_arguments,  nullptr},
+  {"setup",  "", &user_setup,   false, false, no_arguments,  setup_options},
+};
+const std::size_t num_main_commands = sizeof(main_commands) / sizeof(main_commands[0]);
+
+const command_info *find_main_command(const std::string &name) {
+  for (auto &ci : main_commands) {
+    if (name == ci.name) return &ci;
+  }
+  return nullptr;
+}
+
+// Whether the command line may be run by a daemon. 'submit --wait' isn't, as
+// it would keep the daemon from serving other commands while it waits.
+bool can_forward(int argc, char *argv[]) {
+  if (argc < 2 || argv[1][0] == '-') return false;
+  std::string command(argv[1]);
+  if (find_main_command(command)) return false;
+  if ("submit" == command) {
+    for (int i = 2; i < argc; i++) {
+      std::string arg(argv[i]);
+      if (arg == "--wait" || (arg.length() > 1 && arg[0] == '-' && arg[1] != '-' &&
+          arg.find('w') != std::string::npos)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int execute_command_line(int argc, char *argv[]) {
   cmdargs cmd;
   if (!parse_cmdargs(cmd, argc, argv)) {
     Logger::fatal << "Invalid command line arguments." << Logger::endl
@@ -138,8 +262,9 @@ int main(int argc, char *argv[]) {
   std::string command(argv[1]);
 
   try {
-    if ("setup" == command) {
-      return user_setup(cmd);
+    const command_info *main_command = find_main_command(command);
+    if (main_command) {
+      return main_command->helper_fn(cmd);
     } else {
       if (!init_autolab_client()) {
         Logger::fatal << "No user set up on this client yet." << Logger::endl
@@ -149,7 +274,8 @@ int main(int argc, char *argv[]) {
       }
 
       try {
-        command_map.exec_command(cmd, command);
+        exec_command(cmd, command);
+        save_autolab_client_state();
       } catch (Autolab::InvalidTokenException &e) {
         Logger::fatal << "Authorization invalid or expired." << Logger::endl
           << Logger::endl
@@ -172,3 +298,33 @@ int main(int argc, char *argv[]) {
 
   return 0;
 }
+
+// commands that stop early throw command_exit
+int run_command_line(int argc, char *argv[]) {
+  try {
+    return execute_command_line(argc, argv);
+  } catch (command_exit &e) {
+    return e.status;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  // hidden command used by the shell completion script. Handled before
+  // anything else, since it is run on every key press.
+  if (argc >= 2 && std::string(argv[1]) == "__complete") {
+    return complete_command_line(argc >= 3 ? argv[2] : "", main_commands,
+      num_main_commands);
+  }
+
+  int status;
+  if (can_forward(argc, argv) && forward_to_daemon(argc, argv, status)) {
+    return status;
+  }
+
+  status = run_command_line(argc, argv);
+  if (revalidate_in_background()) {
+    // without destroying the client, see revalidate_in_background
+    _exit(status);
+  }
+  return status;
+}
@@ -128,7 +128,7 @@ std::string wrap_text_with_indent(std::size_t indent, std::string text) {
 }
 
 // print a table
-std::string format_table(std::vector<std::vector<std::string>> data) {
+std::string format_table(const std::vector<std::vector<std::string>> &data) {
   std::ostringstream out;
   int num_rows, num_cols;
   num_rows = data.size();
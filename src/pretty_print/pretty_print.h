@@ -27,6 +27,6 @@ std::string center_text(std::size_t width, std::string text);
 
 // advanced string processing
 std::string wrap_text_with_indent(std::size_t indent, std::string text);
-std::string format_table(std::vector<std::vector<std::string>> data);
+std::string format_table(const std::vector<std::vector<std::string>> &data);
 
 #endif /* AUTOLAB_PRETTY_PRINT_H_ */
\ No newline at end of file